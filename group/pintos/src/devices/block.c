@@ -3,7 +3,14 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+
+/* Ticks a request may wait before it is served ahead of the
+   elevator's order. */
+#define BLOCK_DEADLINE 50
 
 /* A block device. */
 struct block
@@ -17,8 +24,24 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    /* Statistics.  Interrupts must be off to update them. */
+    struct blockstat stats;             /* Counts, latencies, depth. */
+    uint64_t registered;                /* timer_cycles() at creation. */
+    uint64_t last_change;               /* timer_cycles() at last
+                                           change of STATS.depth. */
+
+    /* Request queue, unused if OPS->remap or OPS->no_queue is set. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct list queue;                  /* Requests sorted by sector. */
+    struct list fifo;                   /* Requests by arrival. */
+    block_sector_t head;                /* Next sector to sweep from. */
+    struct thread *worker;              /* Thread serving the queue. */
+    struct semaphore events;            /* Up'd per submission and per
+                                           completion in `done'. */
+    struct list done;                   /* Completed by OPS->start's
+                                           driver, with callbacks to
+                                           run.  Interrupts must be off
+                                           to access it. */
   };
 
 /* List of all block devices. */
@@ -28,6 +51,9 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void block_worker (void *block_);
+static void finish (struct block_request *);
+static void notify (struct block_request *);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -99,18 +125,187 @@ block_get_by_name (const char *name)
   return NULL;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
+/* Verifies that the CNT sectors starting at SECTOR are within
+   BLOCK.  Panics if not. */
 static void
-check_sector (struct block *block, block_sector_t sector)
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
 {
-  if (sector >= block->size)
+  if (cnt == 0 || sector >= block->size || cnt > block->size - sector)
     {
       /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
-      PANIC ("Access past end of device %s (sector=%"PRDSNu", "
-             "size=%"PRDSNu")\n", block_name (block), sector, block->size);
+      PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+             "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+             block->size);
+    }
+}
+
+/* Counts a transfer of CNT sectors on BLOCK in its statistics. */
+static void
+count_transfer (struct block *block, bool write, size_t cnt)
+{
+  enum intr_level old_level = intr_disable ();
+  if (write)
+    {
+      block->stats.write_cnt += cnt;
+      block->stats.write_bytes += cnt * BLOCK_SECTOR_SIZE;
+    }
+  else
+    {
+      block->stats.read_cnt += cnt;
+      block->stats.read_bytes += cnt * BLOCK_SECTOR_SIZE;
+    }
+  intr_set_level (old_level);
+}
+
+/* Adds DELTA to the number of requests outstanding on BLOCK at
+   time NOW, first charging the time since the last change to
+   BLOCK's depth and busy time.  Interrupts must be off. */
+static void
+change_depth (struct block *block, uint64_t now, int delta)
+{
+  struct blockstat *s = &block->stats;
+  uint64_t span = now - block->last_change;
+
+  s->depth_time += span * s->depth;
+  if (s->depth > 0)
+    s->busy_time += span;
+  block->last_change = now;
+  s->depth += delta;
+  if (s->depth > s->max_depth)
+    s->max_depth = s->depth;
+}
+
+/* Notes that a request has been handed to BLOCK, counting it as
+   outstanding on BLOCK and each device it remaps to.  Returns
+   the time, to pass to io_end() once the request is done. */
+static uint64_t
+io_begin (struct block *block)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = timer_cycles ();
+  block_sector_t sector = 0;
+
+  for (;;)
+    {
+      change_depth (block, now, 1);
+      if (block->ops->remap == NULL)
+        break;
+      block = block->ops->remap (block->aux, &sector);
     }
+  intr_set_level (old_level);
+  return now;
+}
+
+/* Notes that a request handed to BLOCK at time START is done,
+   undoing io_begin() and counting its latency. */
+static void
+io_end (struct block *block, uint64_t start, bool write)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = timer_cycles ();
+  uint64_t latency = now - start;
+  block_sector_t sector = 0;
+  int bucket = 0;
+
+  while (bucket < BLOCKSTAT_BUCKETS - 1 && latency >> (bucket + 1) != 0)
+    bucket++;
+  for (;;)
+    {
+      change_depth (block, now, -1);
+      if (write)
+        {
+          block->stats.write_reqs++;
+          block->stats.write_lat[bucket]++;
+        }
+      else
+        {
+          block->stats.read_reqs++;
+          block->stats.read_lat[bucket]++;
+        }
+      if (block->ops->remap == NULL)
+        break;
+      block = block->ops->remap (block->aux, &sector);
+    }
+  intr_set_level (old_level);
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at SECTOR
+   to or from BUFFER, as one command if the driver supports it. */
+static void
+transfer (struct block *block, block_sector_t sector, size_t cnt,
+          void *buffer, bool write)
+{
+  const struct block_operations *ops = block->ops;
+  uint8_t *p = buffer;
+
+  if (cnt > 1 && write && ops->write_multi != NULL)
+    ops->write_multi (block->aux, sector, cnt, buffer);
+  else if (cnt > 1 && !write && ops->read_multi != NULL)
+    ops->read_multi (block->aux, sector, cnt, buffer);
+  else
+    for (; cnt > 0; cnt--, sector++, p += BLOCK_SECTOR_SIZE)
+      {
+        if (write)
+          ops->write (block->aux, sector, p);
+        else
+          ops->read (block->aux, sector, p);
+      }
+}
+
+/* Follows BLOCK's remappings of *SECTOR, if any, down to the
+   device that actually holds it, counting a transfer of CNT
+   sectors in the statistics of each device along the way. */
+static struct block *
+resolve (struct block *block, block_sector_t *sector, size_t cnt,
+         bool write)
+{
+  count_transfer (block, write, cnt);
+  while (block->ops->remap != NULL)
+    {
+      block = block->ops->remap (block->aux, sector);
+      count_transfer (block, write, cnt);
+    }
+  return block;
+}
+
+/* Returns the device that actually holds BLOCK's sectors. */
+static struct block *
+physical_block (struct block *block)
+{
+  block_sector_t sector = 0;
+
+  while (block->ops->remap != NULL)
+    block = block->ops->remap (block->aux, &sector);
+  return block;
+}
+
+/* Transfers the CNT sectors starting at SECTOR on BLOCK to or
+   from BUFFER and waits for the transfer to finish.  Goes through
+   BLOCK's queue except where waiting for BLOCK's I/O thread
+   would never end: in an interrupt handler, in the I/O thread
+   itself, or before the I/O thread has started. */
+static void
+transfer_sync (struct block *block, block_sector_t sector, size_t cnt,
+               void *buffer, bool write)
+{
+  struct block *phys = physical_block (block);
+  struct block_request r;
+
+  check_sectors (block, sector, cnt);
+  ASSERT (!write || block->type != BLOCK_FOREIGN);
+  if (intr_context () || phys->worker == NULL
+      || phys->worker == thread_current ())
+    {
+      uint64_t start = io_begin (block);
+      transfer (resolve (block, &sector, cnt, write), sector, cnt, buffer,
+                write);
+      io_end (block, start, write);
+      return;
+    }
+  block_request_init (&r, sector, cnt, buffer, write, NULL, NULL);
+  block_submit (block, &r);
+  block_wait (&r);
 }
 
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
@@ -120,9 +315,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  transfer_sync (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +326,118 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  transfer_sync (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads the CNT sectors starting at SECTOR from BLOCK into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Drivers that support it carry this out as a single
+   command. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  transfer_sync (block, sector, cnt, buffer, false);
+}
+
+/* Writes the CNT sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving the
+   data. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  transfer_sync (block, sector, cnt, (void *) buffer, true);
+}
+
+/* Initializes R as a request to transfer the CNT sectors starting
+   at SECTOR to or from BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes.  If COMPLETE is non-null, it is
+   called with R and AUX once R has been carried out, and may
+   free R; otherwise, the submitter must call block_wait() on R. */
+void
+block_request_init (struct block_request *r, block_sector_t sector,
+                    size_t cnt, void *buffer, bool write,
+                    void (*complete) (struct block_request *, void *),
+                    void *aux)
+{
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->complete = complete;
+  r->aux = aux;
+  sema_init (&r->done, 0);
+}
+
+/* Returns true if request A's sector precedes request B's. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return a->sector < b->sector;
+}
+
+/* Queues request R on BLOCK and returns without waiting for it
+   to be carried out, unless BLOCK has no queue, in which case R
+   is carried out and finished right away.  Requests whose
+   sectors overlap, other than two reads, are carried out in the
+   order submitted. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  check_sectors (block, r->sector, r->cnt);
+  ASSERT (!r->write || block->type != BLOCK_FOREIGN);
+  ASSERT (!intr_context ());
+
+  r->block = block;
+  r->start = io_begin (block);
+  block = resolve (block, &r->sector, r->cnt, r->write);
+  if (block->ops->no_queue)
+    {
+      transfer (block, r->sector, r->cnt, r->buffer, r->write);
+      finish (r);
+      return;
+    }
+  r->deadline = timer_ticks () + BLOCK_DEADLINE;
+  lock_acquire (&block->queue_lock);
+  list_insert_ordered (&block->queue, &r->elem, request_less, NULL);
+  list_push_back (&block->fifo, &r->fifo_elem);
+  lock_release (&block->queue_lock);
+  sema_up (&block->events);
+}
+
+/* Waits until request R has been carried out. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->done);
+}
+
+/* Called by a driver with an OPS->start function, possibly from
+   an interrupt handler, once it has carried out request R on
+   BLOCK. */
+void
+block_complete (struct block *block, struct block_request *r)
+{
+  enum intr_level old_level;
+
+  io_end (r->block, r->start, r->write);
+  if (r->complete == NULL)
+    {
+      sema_up (&r->done);
+      return;
+    }
+
+  /* Leave the callback to BLOCK's I/O thread. */
+  old_level = intr_disable ();
+  list_push_back (&block->done, &r->elem);
+  intr_set_level (old_level);
+  sema_up (&block->events);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,6 +461,33 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Copies BLOCK's statistics into *STATS. */
+void
+block_get_stats (struct block *block, struct blockstat *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = timer_cycles ();
+
+  change_depth (block, now, 0);
+  *stats = block->stats;
+  stats->elapsed = now - block->registered;
+  intr_set_level (old_level);
+}
+
+/* Prints the nonzero buckets of latency histogram LAT, labeled
+   with the base-2 logarithm of their lower bounds. */
+static void
+print_latencies (const char *what, uint64_t reqs, const uint64_t lat[])
+{
+  int i;
+
+  printf ("  %s: %"PRIu64" requests, latency (log2 cycles):", what, reqs);
+  for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+    if (lat[i] != 0)
+      printf (" %d:%"PRIu64, i, lat[i]);
+  printf ("\n");
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -171,9 +499,21 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          struct blockstat s;
+          uint64_t elapsed;
+
+          block_get_stats (block, &s);
+          elapsed = s.elapsed != 0 ? s.elapsed : 1;
+          printf ("%s (%s): %"PRIu64" reads, %"PRIu64" writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  s.read_cnt, s.write_cnt);
+          print_latencies ("reads", s.read_reqs, s.read_lat);
+          print_latencies ("writes", s.write_reqs, s.write_lat);
+          printf ("  depth: %"PRIu32" max, %"PRIu64".%02"PRIu64" avg; "
+                  "busy %"PRIu64"%% of %"PRIu64" cycles\n",
+                  s.max_depth, s.depth_time / elapsed,
+                  s.depth_time % elapsed * 100 / elapsed,
+                  s.busy_time * 100 / elapsed, s.elapsed);
         }
     }
 }
@@ -198,8 +538,21 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  block->registered = block->last_change = timer_cycles ();
+  lock_init (&block->queue_lock);
+  sema_init (&block->events, 0);
+  list_init (&block->done);
+  list_init (&block->queue);
+  list_init (&block->fifo);
+  block->head = 0;
+  block->worker = NULL;
+  if (ops->remap == NULL && !ops->no_queue)
+    {
+      tid_t tid = thread_create (name, PRI_MAX, block_worker, block);
+      if (tid == TID_ERROR)
+        PANIC ("%s: failed to start I/O thread", name);
+    }
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -221,3 +574,191 @@ list_elem_to_block (struct list_elem *list_elem)
           : NULL);
 }
 
+
+/* Returns true if requests A and B touch a common sector and at
+   least one of them is a write, so that their order matters. */
+static bool
+requests_conflict (const struct block_request *a,
+                   const struct block_request *b)
+{
+  return ((a->write || b->write)
+          && a->sector < b->sector + b->cnt
+          && b->sector < a->sector + a->cnt);
+}
+
+/* Returns the earliest request submitted to BLOCK before R that
+   conflicts with R, or a null pointer if there is none. */
+static struct block_request *
+earlier_conflict (struct block *block, struct block_request *r)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&block->fifo); e != &r->fifo_elem; e = list_next (e))
+    {
+      struct block_request *q = list_entry (e, struct block_request,
+                                            fifo_elem);
+      if (requests_conflict (q, r))
+        return q;
+    }
+  return NULL;
+}
+
+/* Removes and returns the next run of requests to carry out from
+   BLOCK's queue, which must not be empty, storing them into
+   BATCH in sector order.  Returns the number of requests.
+
+   The elevator sweeps upward from BLOCK->head and then jumps
+   back to the lowest queued sector (C-SCAN), except that the
+   oldest request goes first once it is past its deadline.  The
+   run continues through requests for following sectors in the
+   same direction, up to BLOCK_BATCH_MAX sectors.  A request never
+   passes an earlier one that it conflicts with. */
+static size_t
+next_batch (struct block *block, struct block_request *batch[])
+{
+  struct block_request *oldest, *r, *q;
+  struct list_elem *e;
+  size_t cnt = 0, sectors = 0;
+
+  ASSERT (!list_empty (&block->queue));
+
+  oldest = list_entry (list_front (&block->fifo),
+                       struct block_request, fifo_elem);
+  if (timer_ticks () >= oldest->deadline)
+    r = oldest;
+  else
+    {
+      for (e = list_begin (&block->queue); e != list_end (&block->queue);
+           e = list_next (e))
+        if (list_entry (e, struct block_request, elem)->sector >= block->head)
+          break;
+      if (e == list_end (&block->queue))
+        e = list_begin (&block->queue);
+      r = list_entry (e, struct block_request, elem);
+      while ((q = earlier_conflict (block, r)) != NULL)
+        r = q;
+    }
+
+  for (;;)
+    {
+      e = list_remove (&r->elem);
+      list_remove (&r->fifo_elem);
+      batch[cnt++] = r;
+      sectors += r->cnt;
+      if (e == list_end (&block->queue))
+        break;
+      r = list_entry (e, struct block_request, elem);
+      if (r->sector != batch[cnt - 1]->sector + batch[cnt - 1]->cnt
+          || r->write != batch[0]->write
+          || sectors + r->cnt > BLOCK_BATCH_MAX
+          || earlier_conflict (block, r) != NULL)
+        break;
+    }
+  block->head = batch[cnt - 1]->sector + batch[cnt - 1]->cnt;
+  return cnt;
+}
+
+/* Carries out the CNT requests in BATCH, which cover consecutive
+   sectors of BLOCK in the same direction.  If there are several
+   and BLOCK's driver can transfer many sectors at once, gathers
+   them through BOUNCE, which has room for BLOCK_BATCH_MAX
+   sectors, into a single transfer. */
+static void
+dispatch (struct block *block, struct block_request *batch[], size_t cnt,
+          uint8_t *bounce)
+{
+  bool write = batch[0]->write;
+  bool multi = (write ? block->ops->write_multi != NULL
+                : block->ops->read_multi != NULL);
+  size_t sectors = 0, ofs, i;
+
+  for (i = 0; i < cnt; i++)
+    sectors += batch[i]->cnt;
+
+  if (cnt == 1 || !multi || bounce == NULL || sectors > BLOCK_BATCH_MAX)
+    {
+      for (i = 0; i < cnt; i++)
+        transfer (block, batch[i]->sector, batch[i]->cnt,
+                  batch[i]->buffer, write);
+      return;
+    }
+
+  if (write)
+    for (i = 0, ofs = 0; i < cnt; ofs += batch[i++]->cnt * BLOCK_SECTOR_SIZE)
+      memcpy (bounce + ofs, batch[i]->buffer,
+              batch[i]->cnt * BLOCK_SECTOR_SIZE);
+  transfer (block, batch[0]->sector, sectors, bounce, write);
+  if (!write)
+    for (i = 0, ofs = 0; i < cnt; ofs += batch[i++]->cnt * BLOCK_SECTOR_SIZE)
+      memcpy (batch[i]->buffer, bounce + ofs,
+              batch[i]->cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Finishes request R, which has been carried out, by counting it
+   in the statistics and then notifying its submitter. */
+static void
+finish (struct block_request *r)
+{
+  io_end (r->block, r->start, r->write);
+  notify (r);
+}
+
+/* Notifies the submitter of finished request R by calling its
+   callback or waking it up. */
+static void
+notify (struct block_request *r)
+{
+  if (r->complete != NULL)
+    r->complete (r, r->aux);
+  else
+    sema_up (&r->done);
+}
+
+/* I/O thread for BLOCK_: carries out queued requests forever.
+   Requests go to the driver one batch at a time.  With an
+   OPS->start function, the driver may hold many batches at once
+   and reports each request back through block_complete(). */
+static void
+block_worker (void *block_)
+{
+  struct block *block = block_;
+  struct block_request *batch[BLOCK_BATCH_MAX];
+  uint8_t *bounce = malloc (BLOCK_BATCH_MAX * BLOCK_SECTOR_SIZE);
+
+  block->worker = thread_current ();
+  for (;;)
+    {
+      size_t cnt, i;
+
+      sema_down (&block->events);
+
+      /* Run callbacks for requests the driver has completed. */
+      for (;;)
+        {
+          enum intr_level old_level = intr_disable ();
+          struct list_elem *e = (list_empty (&block->done) ? NULL
+                                 : list_pop_front (&block->done));
+          intr_set_level (old_level);
+          if (e == NULL)
+            break;
+          notify (list_entry (e, struct block_request, elem));
+        }
+
+      /* There may be less to do than EVENTS suggests, because a
+         batch takes several requests at once. */
+      lock_acquire (&block->queue_lock);
+      cnt = list_empty (&block->queue) ? 0 : next_batch (block, batch);
+      lock_release (&block->queue_lock);
+      if (cnt == 0)
+        continue;
+
+      if (block->ops->start != NULL)
+        block->ops->start (block->aux, batch, cnt);
+      else
+        {
+          dispatch (block, batch, cnt, bounce);
+          for (i = 0; i < cnt; i++)
+            finish (batch[i]);
+        }
+    }
+}
@@ -1,8 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <blockstat.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +57,54 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multi (struct block *, block_sector_t, size_t cnt, void *);
+void block_write_multi (struct block *, block_sector_t, size_t cnt,
+                        const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Most sectors in a batch of merged requests. */
+#define BLOCK_BATCH_MAX 16
+
+/* Asynchronous requests.
+
+   A request is queued on its device with block_submit() and
+   carried out later by the device's I/O thread, which serves
+   each device's queue in C-SCAN order, merging runs of adjacent
+   sectors, unless some request has waited too long.  On
+   completion, the request's COMPLETE function is called from the
+   I/O thread, or if it has none, block_wait() returns.  The
+   caller owns the request and its buffer and must keep both
+   alive until then. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in sorted queue,
+                                           then in done list. */
+    struct list_elem fifo_elem;         /* Element in arrival order. */
+    block_sector_t sector;              /* First sector to transfer. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                         /* Write, as opposed to read? */
+    int64_t deadline;                   /* Served by this tick at latest. */
+    struct block *block;                /* Device submitted to. */
+    uint64_t start;                     /* timer_cycles() at submission. */
+    void (*complete) (struct block_request *, void *aux);
+    void *aux;                          /* Passed to COMPLETE. */
+    struct semaphore done;              /* Upped on completion
+                                           if COMPLETE is null. */
+  };
+
+void block_request_init (struct block_request *, block_sector_t,
+                         size_t cnt, void *buffer, bool write,
+                         void (*complete) (struct block_request *, void *),
+                         void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+void block_complete (struct block *, struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
+void block_get_stats (struct block *, struct blockstat *);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,6 +112,31 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors at once. */
+    void (*read_multi) (void *aux, block_sector_t, size_t cnt,
+                        void *buffer);
+    void (*write_multi) (void *aux, block_sector_t, size_t cnt,
+                         const void *buffer);
+
+    /* Optional.  Starts carrying out the CNT requests in BATCH,
+       which cover consecutive sectors in the same direction, and
+       returns without waiting for them, although it may sleep
+       until the device has room for them.  The driver calls
+       block_complete() on each request once it is done.  A
+       driver with this function can have many batches in flight
+       at once. */
+    void (*start) (void *aux, struct block_request **batch, size_t cnt);
+
+    /* Optional.  For a device that only forwards to a region of
+       another one, translates *SECTOR and returns the other
+       device, so that requests are queued there instead. */
+    struct block *(*remap) (void *aux, block_sector_t *sector);
+
+    /* Carry out requests in the submitting thread instead of
+       queuing them, for devices with no latency to hide, such as
+       RAM disks. */
+    bool no_queue;
   };
 
 struct block *block_register (const char *name, enum block_type,
@@ -5,10 +5,13 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
    controller.  It attempts to comply to [ATA-3]. */
@@ -30,10 +33,24 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus-master DMA port addresses, found through PCI. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus-master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start transfer. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus-master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Transfer failed (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Disk interrupted (write 1 to clear). */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +66,27 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* A physical region descriptor, one entry of the table that
+   tells the bus master where to move data.  A region may not
+   cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Bytes, with 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+
+/* Most sectors transferred by one command.  The sector count
+   register holds 0 to mean 256. */
+#define MAX_SECTORS_PER_CMD 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +95,9 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Use bus-master DMA? */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +113,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus-master DMA registers, or 0. */
+    struct prd *prdt;           /* PRD table for DMA, one page. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -85,7 +129,11 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void find_bus_master (void);
+static void set_multiple_mode (struct ata_disk *, int max);
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          void *, bool write);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -103,6 +151,7 @@ ide_init (void)
 {
   size_t chan_no;
 
+  find_bus_master ();
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -123,7 +172,7 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      lock_init_named (&c->lock, c->name);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
 
@@ -136,6 +185,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -303,6 +354,13 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Word 49 bit 8 says whether the disk can do DMA. */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
+
+  /* Word 47 gives the most sectors the disk can move per
+     interrupt in READ/WRITE MULTIPLE, in its low byte. */
+  set_multiple_mode (d, *(uint16_t *) &id[47 * 2] & 0xff);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
@@ -337,63 +395,291 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Looks for a PCI IDE controller with bus-master DMA that drives
+   the legacy channels, and if there is one, sets up both
+   channels to use it.  Channels without it stay PIO only. */
+static void
+find_bus_master (void)
+{
+  struct pci_addr a;
+  uint8_t prog_if;
+  uint16_t bm_base;
+  size_t chan_no;
+
+  if (!pci_find_class (0x01, 0x01, &a))
+    return;
+
+  /* Bits 0 and 2 of the programming interface are set for
+     channels in native mode, which use other ports than ours.
+     Bit 7 says the controller can be a bus master. */
+  prog_if = pci_read_config (&a, PCI_REG_CLASS) >> 8;
+  bm_base = pci_io_bar (&a, 4);
+  if ((prog_if & 0x05) != 0 || !(prog_if & 0x80) || bm_base == 0)
+    return;
+  pci_enable_bus_master (&a);
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      c->prdt = palloc_get_page (0);
+      if (c->prdt != NULL)
+        c->bm_base = bm_base + chan_no * 8;
+    }
+}
+
+/* Points channel C's PRD table at the SIZE bytes at BUFFER.
+   Returns false if BUFFER is not suitable for DMA, in which case
+   the caller must use PIO. */
+static bool
+build_prdt (struct channel *c, void *buffer, size_t size)
+{
+  uint8_t *p = buffer;
+  size_t i = 0;
+
+  /* The bus master needs a physical address, which only kernel
+     virtual addresses have, and moves whole 16-bit words. */
+  if (!is_kernel_vaddr (buffer) || ((uintptr_t) buffer & 1) != 0)
+    return false;
+
+  while (size > 0)
+    {
+      uintptr_t phys = vtop (p);
+      size_t chunk = 0x10000 - (phys & 0xffff);
+      if (chunk > size)
+        chunk = size;
+      if (i >= PRD_CNT)
+        return false;
+
+      c->prdt[i].addr = phys;
+      c->prdt[i].size = chunk & 0xffff;
+      c->prdt[i].flags = 0;
+      i++;
+      p += chunk;
+      size -= chunk;
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Moves the CNT sectors starting at SEC_NO between disk D and
+   BUFFER by bus-master DMA, as one command, reading from the disk
+   if WRITE is false.  The CPU is free to run other threads until
+   the disk interrupts.  Returns false if the transfer could not
+   be done by DMA or failed, in which case the caller should fall
+   back to PIO.  D's channel lock must be held. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t bm_status;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
+
+  if (!build_prdt (c, buffer, cnt * BLOCK_SECTOR_SIZE))
+    return false;
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), write ? 0 : BM_CMD_READ);
+  outb (reg_bm_status (c),
+        inb (reg_bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), inb (reg_bm_command (c)) | BM_CMD_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), inb (reg_bm_command (c)) & ~BM_CMD_START);
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_STA_ERR | BM_STA_INTR);
+  return !(bm_status & BM_STA_ERR) && !(inb (reg_status (c)) & STA_ERR);
+}
+
+/* Tries to move the CNT sectors starting at SEC_NO between disk D
+   and BUFFER by DMA, as dma_transfer().  If DMA fails, turns it
+   off for D for good.  Returns true if successful, false if the
+   caller must use PIO instead. */
+static bool
+try_dma (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+         void *buffer, bool write)
+{
+  uint8_t *p = buffer;
+
+  if (!d->dma || !build_prdt (d->channel, buffer, cnt * BLOCK_SECTOR_SIZE))
+    return false;
+
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      if (!dma_transfer (d, sec_no, n, p, write))
+        {
+          printf ("%s: DMA failed, falling back to PIO\n", d->name);
+          d->dma = false;
+          return false;
+        }
+      sec_no += n;
+      cnt -= n;
+      p += n * BLOCK_SECTOR_SIZE;
+    }
+  return true;
+}
+
+/* Enables READ/WRITE MULTIPLE on disk D with the largest block
+   size up to MAX sectors that is a power of 2, as the standard
+   requires.  Leaves them disabled if MAX is 0 or D refuses. */
+static void
+set_multiple_mode (struct ata_disk *d, int max)
+{
+  struct channel *c = d->channel;
+  int multiple = 1;
+
+  d->multiple = 0;
+  if (max < 2)
+    return;
+  while (multiple * 2 <= max)
+    multiple *= 2;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), multiple);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (!(inb (reg_status (c)) & STA_ERR))
+    d->multiple = multiple;
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Uses DMA if possible.  Otherwise, issues one PIO command per
+   MAX_SECTORS_PER_CMD sectors, which with READ MULTIPLE also
+   interrupts only once per D->multiple sectors.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_read_multi (void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  if (try_dma (d, sec_no, cnt, buffer, false))
+    cnt = 0;
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      int per_intr = n > 1 && d->multiple > 0 ? d->multiple : 1;
+      size_t done = 0;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, per_intr > 1 ? CMD_READ_MULTIPLE
+                                         : CMD_READ_SECTOR_RETRY);
+      while (done < n)
+        {
+          size_t block_cnt = n - done < (size_t) per_intr ? n - done
+                                                          : (size_t) per_intr;
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (; block_cnt > 0; block_cnt--, done++, p += BLOCK_SECTOR_SIZE)
+            input_sector (c, p);
+        }
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes, as
+   ide_read_multi() reads them.  Returns after the disk has
    acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write_multi (void *d_, block_sector_t sec_no, size_t cnt,
+                 const void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
+  if (try_dma (d, sec_no, cnt, (void *) buffer, true))
+    cnt = 0;
+  while (cnt > 0)
+    {
+      size_t n = cnt < MAX_SECTORS_PER_CMD ? cnt : MAX_SECTORS_PER_CMD;
+      int per_intr = n > 1 && d->multiple > 0 ? d->multiple : 1;
+      size_t done = 0;
+
+      select_sector (d, sec_no, n);
+      issue_pio_command (c, per_intr > 1 ? CMD_WRITE_MULTIPLE
+                                         : CMD_WRITE_SECTOR_RETRY);
+      while (done < n)
+        {
+          size_t block_cnt = n - done < (size_t) per_intr ? n - done
+                                                          : (size_t) per_intr;
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + done);
+          for (; block_cnt > 0; block_cnt--, done++, p += BLOCK_SECTOR_SIZE)
+            output_sector (c, p);
+          sema_down (&c->completion_wait);
+        }
+      sec_no += n;
+      cnt -= n;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_read_multi (d_, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+{
+  ide_write_multi (d_, sec_no, 1, buffer);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi,
+    NULL,
+    NULL,
+    false
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT to the disk's
+   sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_SECTORS_PER_CMD);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt % MAX_SECTORS_PER_CMD);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
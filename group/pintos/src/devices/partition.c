@@ -317,8 +317,23 @@ partition_write (void *p_, block_sector_t sector, const void *buffer)
   block_write (p->block, p->start + sector, buffer);
 }
 
+/* Redirects requests for SECTOR in partition P_ to the
+   underlying device. */
+static struct block *
+partition_remap (void *p_, block_sector_t *sector)
+{
+  struct partition *p = p_;
+  *sector += p->start;
+  return p->block;
+}
+
 static struct block_operations partition_operations =
   {
     partition_read,
-    partition_write
+    partition_write,
+    NULL,
+    NULL,
+    NULL,
+    partition_remap,
+    false
   };
@@ -0,0 +1,138 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* The code in this file accesses PCI configuration space through
+   configuration mechanism #1, which every PC chipset that Pintos
+   runs on supports.  Only bus 0 is scanned, which is where QEMU
+   and Bochs put all of their devices. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDR 0xcf8   /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc   /* Reads or writes the register. */
+
+/* Number of device slots on a bus and functions per device. */
+#define PCI_DEV_CNT 32
+#define PCI_FUNC_CNT 8
+
+/* Selects configuration register REG of the function at A. */
+static void
+select_config (const struct pci_addr *a, uint8_t reg)
+{
+  ASSERT (a->dev < PCI_DEV_CNT && a->func < PCI_FUNC_CNT);
+  outl (PCI_CONFIG_ADDR, (0x80000000u | (a->bus << 16) | (a->dev << 11)
+                          | (a->func << 8) | (reg & 0xfc)));
+}
+
+/* Returns the 32-bit configuration register REG, which must be a
+   multiple of 4, of the function at A. */
+uint32_t
+pci_read_config (const struct pci_addr *a, uint8_t reg)
+{
+  select_config (a, reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit configuration register REG, which
+   must be a multiple of 4, of the function at A. */
+void
+pci_write_config (const struct pci_addr *a, uint8_t reg, uint32_t value)
+{
+  select_config (a, reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Searches bus 0 for functions for which MATCH returns true,
+   given AUX.  If there are more than NTH of them, stores the
+   location of the NTH one, counting from 0, in *A and returns
+   true; otherwise, returns false. */
+static bool
+find (bool (*match) (const struct pci_addr *, void *aux), void *aux,
+      size_t nth, struct pci_addr *a)
+{
+  a->bus = 0;
+  for (a->dev = 0; a->dev < PCI_DEV_CNT; a->dev++)
+    for (a->func = 0; a->func < PCI_FUNC_CNT; a->func++)
+      {
+        if ((pci_read_config (a, PCI_REG_ID) & 0xffff) == 0xffff)
+          {
+            /* Nothing here.  A missing function 0 means an empty
+               slot. */
+            if (a->func == 0)
+              break;
+            continue;
+          }
+
+        if (match (a, aux) && nth-- == 0)
+          return true;
+
+        /* Only multi-function devices have functions past 0. */
+        if (a->func == 0
+            && !(pci_read_config (a, PCI_REG_HEADER) & 0x00800000))
+          break;
+      }
+  return false;
+}
+
+/* Returns true if the function at A has the class and subclass
+   in CLASSES_, which points to them packed into a uint16_t. */
+static bool
+match_class (const struct pci_addr *a, void *classes_)
+{
+  const uint16_t *classes = classes_;
+  return (pci_read_config (a, PCI_REG_CLASS) >> 16) == *classes;
+}
+
+/* Returns true if the function at A has the vendor and device IDs
+   in IDS_, which points to them packed into a uint32_t. */
+static bool
+match_id (const struct pci_addr *a, void *ids_)
+{
+  const uint32_t *ids = ids_;
+  return pci_read_config (a, PCI_REG_ID) == *ids;
+}
+
+/* Searches bus 0 for the first function with the given CLASS and
+   SUBCLASS codes.  If one is found, stores its location in *A
+   and returns true; otherwise, returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *a)
+{
+  uint16_t classes = (class << 8) | subclass;
+  return find (match_class, &classes, 0, a);
+}
+
+/* Searches bus 0 for functions with the given VENDOR and DEVICE
+   IDs.  If there are more than NTH of them, stores the location
+   of the NTH one, counting from 0, in *A and returns true;
+   otherwise, returns false. */
+bool
+pci_find_device (uint16_t vendor, uint16_t device, size_t nth,
+                 struct pci_addr *a)
+{
+  uint32_t ids = ((uint32_t) device << 16) | vendor;
+  return find (match_id, &ids, nth, a);
+}
+
+/* Returns the I/O port base of base address register BAR of the
+   function at A, or 0 if BAR is unused or maps memory rather
+   than I/O ports. */
+uint16_t
+pci_io_bar (const struct pci_addr *a, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (a, PCI_REG_BAR0 + bar * 4);
+  return (value & 1) ? value & 0xfffc : 0;
+}
+
+/* Allows the function at A to respond to I/O port accesses and
+   to perform DMA. */
+void
+pci_enable_bus_master (const struct pci_addr *a)
+{
+  uint32_t command = pci_read_config (a, PCI_REG_COMMAND);
+  command = (command & 0xffff) | PCI_CMD_IO | PCI_CMD_BUS_MASTER;
+  pci_write_config (a, PCI_REG_COMMAND, command);
+}
@@ -0,0 +1,38 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Location of a function on the PCI bus. */
+struct pci_addr
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t dev;                /* Device number, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Standard configuration space registers. */
+#define PCI_REG_ID 0x00         /* Vendor ID (0:15), Device ID (16:31). */
+#define PCI_REG_COMMAND 0x04    /* Command (0:15), Status (16:31). */
+#define PCI_REG_CLASS 0x08      /* Revision, Prog IF, Subclass, Class. */
+#define PCI_REG_HEADER 0x0c     /* Header type in bits 16:23. */
+#define PCI_REG_BAR0 0x10       /* First of six base address registers. */
+#define PCI_REG_IRQ 0x3c        /* Interrupt line in bits 0:7. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001           /* Respond to I/O space accesses. */
+#define PCI_CMD_MEMORY 0x0002       /* Respond to memory accesses. */
+#define PCI_CMD_BUS_MASTER 0x0004   /* May initiate DMA. */
+
+uint32_t pci_read_config (const struct pci_addr *, uint8_t reg);
+void pci_write_config (const struct pci_addr *, uint8_t reg, uint32_t);
+
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_addr *);
+bool pci_find_device (uint16_t vendor, uint16_t device, size_t nth,
+                      struct pci_addr *);
+uint16_t pci_io_bar (const struct pci_addr *, int bar);
+void pci_enable_bus_master (const struct pci_addr *);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,181 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* The code in this file implements block devices backed by
+   kernel memory, named rd0, rd1, and so on, each configured by a
+   "-ramdisk=KB[@BDEV]" option on the kernel command line.  A RAM
+   disk is KB kB in size, rounded up to a whole page.  If BDEV is
+   given, the RAM disk starts out as a copy of block device BDEV,
+   and if KB is 0, it is as big as BDEV.  Otherwise it starts out
+   zeroed.
+
+   RAM disk requests never wait, so they bypass the block layer's
+   request queue and are carried out in the caller's thread. */
+
+/* Sectors per page of a RAM disk. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Most RAM disks. */
+#define RAMDISK_MAX 4
+
+/* A RAM disk. */
+struct ramdisk
+  {
+    block_sector_t size;        /* Size in sectors. */
+    uint8_t **pages;            /* Backing pages. */
+  };
+
+/* Command line specifications of RAM disks to create. */
+static const char *specs[RAMDISK_MAX];
+static size_t spec_cnt;
+
+static struct block_operations ramdisk_operations;
+
+static void create_ramdisk (size_t idx, const char *spec);
+
+/* Adds a RAM disk given by SPEC, a "KB[@BDEV]" string, to those
+   that ramdisk_init() will create. */
+void
+ramdisk_configure (const char *spec)
+{
+  if (spec == NULL)
+    PANIC ("-ramdisk requires a size");
+  if (spec_cnt >= RAMDISK_MAX)
+    PANIC ("at most %d RAM disks are supported", RAMDISK_MAX);
+  specs[spec_cnt++] = spec;
+}
+
+/* Creates and registers the RAM disks given on the command line.
+   Must be called after the devices they are copied from have
+   been registered. */
+void
+ramdisk_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < spec_cnt; i++)
+    create_ramdisk (i, specs[i]);
+}
+
+/* Creates RAM disk number IDX as SPEC says. */
+static void
+create_ramdisk (size_t idx, const char *spec)
+{
+  struct ramdisk *rd;
+  struct block *from = NULL, *block;
+  const char *from_name = strchr (spec, '@');
+  block_sector_t size = ROUND_UP (atoi (spec) * (1024 / BLOCK_SECTOR_SIZE),
+                                  SECTORS_PER_PAGE);
+  size_t page_cnt, i;
+  char name[16], extra_info[32];
+
+  if (from_name != NULL)
+    {
+      from = block_get_by_name (from_name + 1);
+      if (from == NULL)
+        PANIC ("No such block device \"%s\"", from_name + 1);
+      if (size == 0)
+        size = ROUND_UP (block_size (from), SECTORS_PER_PAGE);
+    }
+  if (size == 0)
+    PANIC ("RAM disk \"%s\" is empty", spec);
+
+  /* Allocate memory, page by page, since the kernel pool may not
+     have that many contiguous pages. */
+  page_cnt = size / SECTORS_PER_PAGE;
+  rd = malloc (sizeof *rd);
+  if (rd == NULL
+      || (rd->pages = calloc (page_cnt, sizeof *rd->pages)) == NULL)
+    PANIC ("Failed to allocate memory for RAM disk descriptor");
+  rd->size = size;
+  for (i = 0; i < page_cnt; i++)
+    {
+      rd->pages[i] = palloc_get_page (PAL_ZERO);
+      if (rd->pages[i] == NULL)
+        PANIC ("Out of memory for %'"PRDSNu"-sector RAM disk", size);
+    }
+
+  /* Copy FROM a page at a time. */
+  if (from != NULL)
+    for (i = 0; i < page_cnt; i++)
+      {
+        block_sector_t sector = i * SECTORS_PER_PAGE;
+        block_sector_t cnt;
+
+        if (sector >= block_size (from))
+          break;
+        cnt = block_size (from) - sector;
+        if (cnt > SECTORS_PER_PAGE)
+          cnt = SECTORS_PER_PAGE;
+        block_read_multi (from, sector, cnt, rd->pages[i]);
+      }
+
+  snprintf (name, sizeof name, "rd%zu", idx);
+  if (from != NULL)
+    snprintf (extra_info, sizeof extra_info, "copy of %s", block_name (from));
+  block = block_register (name, BLOCK_RAW, from != NULL ? extra_info : NULL,
+                          size, &ramdisk_operations, rd);
+  if (from != NULL)
+    partition_scan (block);
+}
+
+/* Returns the address of SECTOR in RD_. */
+static uint8_t *
+sector_addr (void *rd_, block_sector_t sector)
+{
+  struct ramdisk *rd = rd_;
+  return (rd->pages[sector / SECTORS_PER_PAGE]
+          + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE);
+}
+
+static void
+ramdisk_read_multi (void *rd_, block_sector_t sector, size_t cnt,
+                    void *buffer)
+{
+  uint8_t *p = buffer;
+
+  for (; cnt > 0; cnt--, sector++, p += BLOCK_SECTOR_SIZE)
+    memcpy (p, sector_addr (rd_, sector), BLOCK_SECTOR_SIZE);
+}
+
+static void
+ramdisk_write_multi (void *rd_, block_sector_t sector, size_t cnt,
+                     const void *buffer)
+{
+  const uint8_t *p = buffer;
+
+  for (; cnt > 0; cnt--, sector++, p += BLOCK_SECTOR_SIZE)
+    memcpy (sector_addr (rd_, sector), p, BLOCK_SECTOR_SIZE);
+}
+
+static void
+ramdisk_read (void *rd_, block_sector_t sector, void *buffer)
+{
+  ramdisk_read_multi (rd_, sector, 1, buffer);
+}
+
+static void
+ramdisk_write (void *rd_, block_sector_t sector, const void *buffer)
+{
+  ramdisk_write_multi (rd_, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multi,
+    ramdisk_write_multi,
+    NULL,
+    NULL,
+    true
+  };
@@ -0,0 +1,186 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/malloc.h"
+
+/* The code in this file implements a striped ("RAID-0") block
+   device, md0, that spreads its sectors over two or more member
+   devices given by a "-stripe=BDEV,BDEV[,...][/KB]" option on
+   the kernel command line.  Consecutive runs of KB kB, 4 kB by
+   default, go to each member in turn, so that a large transfer
+   keeps all of them busy.  For the most parallelism, pick
+   members on different IDE channels, e.g. "-stripe=hdb,hdc",
+   and then use it with e.g. "-filesys=md0".
+
+   A transfer on md0 is broken into one request per stripe unit,
+   which are submitted to the members' queues all at once and
+   then waited for, so it needs no queue of its own. */
+
+/* Most member devices. */
+#define STRIPE_MAX_MEMBERS 4
+
+/* Default stripe unit, in sectors. */
+#define STRIPE_DEFAULT_UNIT 8
+
+/* Most member requests in flight for one md0 transfer.  Each
+   takes room on the kernel stack. */
+#define STRIPE_MAX_REQUESTS 8
+
+/* A striped device. */
+struct stripe
+  {
+    struct block *members[STRIPE_MAX_MEMBERS]; /* Member devices. */
+    size_t member_cnt;                  /* Number of members. */
+    block_sector_t unit;                /* Sectors per stripe unit. */
+  };
+
+/* Command line specification, if any. */
+static const char *spec;
+
+static struct block_operations stripe_operations;
+
+/* Sets SPEC_, a "BDEV,BDEV[,...][/KB]" string, as the
+   specification of the striped device for stripe_init() to
+   create. */
+void
+stripe_configure (const char *spec_)
+{
+  if (spec_ == NULL)
+    PANIC ("-stripe requires a list of block devices");
+  spec = spec_;
+}
+
+/* Creates and registers the striped device given on the command
+   line, if any.  Must be called after its members have been
+   registered. */
+void
+stripe_init (void)
+{
+  struct stripe *s;
+  block_sector_t member_size = 0;
+  char buf[128], *unit, *name, *save_ptr;
+  char extra_info[64];
+  size_t i;
+
+  if (spec == NULL)
+    return;
+
+  s = malloc (sizeof *s);
+  if (s == NULL)
+    PANIC ("Failed to allocate memory for striped device descriptor");
+  s->member_cnt = 0;
+  s->unit = STRIPE_DEFAULT_UNIT;
+
+  strlcpy (buf, spec, sizeof buf);
+  unit = strchr (buf, '/');
+  if (unit != NULL)
+    {
+      *unit++ = '\0';
+      s->unit = atoi (unit) * (1024 / BLOCK_SECTOR_SIZE);
+      if (s->unit == 0)
+        PANIC ("Bad stripe unit \"%s\"", unit);
+    }
+
+  for (name = strtok_r (buf, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *member = block_get_by_name (name);
+      if (member == NULL)
+        PANIC ("No such block device \"%s\"", name);
+      if (s->member_cnt >= STRIPE_MAX_MEMBERS)
+        PANIC ("At most %d devices may be striped", STRIPE_MAX_MEMBERS);
+      for (i = 0; i < s->member_cnt; i++)
+        if (s->members[i] == member)
+          PANIC ("Block device \"%s\" striped twice", name);
+      if (s->member_cnt == 0 || block_size (member) < member_size)
+        member_size = block_size (member);
+      s->members[s->member_cnt++] = member;
+    }
+  if (s->member_cnt < 2)
+    PANIC ("Striping requires at least two block devices");
+
+  /* Only whole stripe units of the smallest member are used. */
+  member_size -= member_size % s->unit;
+  if (member_size == 0)
+    PANIC ("Striped devices are smaller than one stripe unit");
+
+  snprintf (extra_info, sizeof extra_info, "%zu-way striped, %'"PRDSNu
+            "-sector unit", s->member_cnt, s->unit);
+  block_register ("md0", BLOCK_RAW, extra_info,
+                  member_size * s->member_cnt, &stripe_operations, s);
+}
+
+/* Transfers the CNT sectors starting at SECTOR on S to or from
+   BUFFER, as one request per stripe unit touched, up to
+   STRIPE_MAX_REQUESTS of them in flight at a time. */
+static void
+stripe_transfer (struct stripe *s, block_sector_t sector, size_t cnt,
+                 void *buffer, bool write)
+{
+  struct block_request requests[STRIPE_MAX_REQUESTS];
+  uint8_t *p = buffer;
+
+  while (cnt > 0)
+    {
+      size_t req_cnt = 0, i;
+
+      for (; cnt > 0 && req_cnt < STRIPE_MAX_REQUESTS; req_cnt++)
+        {
+          block_sector_t unit_nr = sector / s->unit;
+          block_sector_t ofs = sector % s->unit;
+          size_t chunk = s->unit - ofs;
+          struct block_request *r = &requests[req_cnt];
+
+          if (chunk > cnt)
+            chunk = cnt;
+          block_request_init (r, unit_nr / s->member_cnt * s->unit + ofs,
+                              chunk, p, write, NULL, NULL);
+          block_submit (s->members[unit_nr % s->member_cnt], r);
+
+          sector += chunk;
+          cnt -= chunk;
+          p += chunk * BLOCK_SECTOR_SIZE;
+        }
+      for (i = 0; i < req_cnt; i++)
+        block_wait (&requests[i]);
+    }
+}
+
+static void
+stripe_read_multi (void *s, block_sector_t sector, size_t cnt, void *buffer)
+{
+  stripe_transfer (s, sector, cnt, buffer, false);
+}
+
+static void
+stripe_write_multi (void *s, block_sector_t sector, size_t cnt,
+                    const void *buffer)
+{
+  stripe_transfer (s, sector, cnt, (void *) buffer, true);
+}
+
+static void
+stripe_read (void *s, block_sector_t sector, void *buffer)
+{
+  stripe_transfer (s, sector, 1, buffer, false);
+}
+
+static void
+stripe_write (void *s, block_sector_t sector, const void *buffer)
+{
+  stripe_transfer (s, sector, 1, (void *) buffer, true);
+}
+
+static struct block_operations stripe_operations =
+  {
+    stripe_read,
+    stripe_write,
+    stripe_read_multi,
+    stripe_write_multi,
+    NULL,
+    NULL,
+    true
+  };
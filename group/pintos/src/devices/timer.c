@@ -7,6 +7,8 @@
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 
 /* See [8254] for hardware details of the 8254 timer chip. */
 
@@ -24,6 +26,24 @@ static int64_t ticks;
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* If true, stop the periodic tick while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* PIT cycles per timer tick. */
+#define PIT_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Tickless idle state.  While the idle thread waits, the PIT may
+   be switched to a one-shot countdown of oneshot_count cycles
+   that ends on the tick boundary oneshot_ticks ticks away.
+   oneshot_ticks is 0 while the PIT is ticking periodically.
+   oneshot_remaining is the part of oneshot_count that ran up to
+   the first of those boundaries. */
+static int oneshot_ticks;
+static uint16_t oneshot_count;
+static uint16_t oneshot_remaining;
+static int64_t timer_irqs;      /* Number of timer interrupts. */
+
 static intr_handler_func timer_interrupt;
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
@@ -76,6 +96,18 @@ timer_ticks (void)
   return t;
 }
 
+/* Returns the CPU's time-stamp counter, which counts clock
+   cycles since the CPU was reset.  Finer grained than
+   timer_ticks(), but the cycle rate depends on the CPU. */
+uint64_t
+timer_cycles (void)
+{
+  /* See [IA32-v2b] "RDTSC". */
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
 /* Returns the number of timer ticks elapsed since THEN, which
    should be a value once returned by timer_ticks(). */
 int64_t
@@ -165,16 +197,120 @@ void
 timer_print_stats (void)
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" interrupts (tickless idle)\n", timer_irqs);
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  If tickless idle is enabled and the next sleeper is
+   more than a tick away, replaces the periodic tick by a single
+   interrupt on the tick boundary where that sleeper, or delayed
+   work, is due, or as far ahead as the PIT's 16-bit counter
+   reaches. */
+void
+timer_idle_enter (void)
+{
+  int64_t wakeup;
+  uint16_t remaining;
+  int n, max;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || oneshot_ticks != 0)
+    return;
+
+  /* In mode 2 the count runs down from PIT_TICK to the next tick
+     boundary.  Don't race a tick that is about to happen: its
+     interrupt would be taken as the end of the one-shot. */
+  remaining = pit_read_count (0, NULL);
+  if (remaining < PIT_TICK / 16 || remaining > PIT_TICK)
+    return;
+
+  wakeup = thread_next_wakeup ();
+  if (workqueue_next_due () < wakeup)
+    wakeup = workqueue_next_due ();
+  max = (UINT16_MAX - remaining) / PIT_TICK + 1;
+  n = wakeup - ticks < max ? wakeup - ticks : max;
+  if (n <= 1)
+    return;
+
+  oneshot_ticks = n;
+  oneshot_remaining = remaining;
+  oneshot_count = remaining + (n - 1) * PIT_TICK;
+  pit_start_oneshot (oneshot_count);
+}
+
+/* Called by the scheduler, with interrupts off, when the idle
+   thread gives up the CPU.  If the idle thread had stopped the
+   periodic tick, brings `ticks' up to date from the time that
+   actually elapsed and arranges for the periodic tick to resume
+   on the same tick boundaries as before.  Returns the number of
+   ticks accounted for, which were all spent idle. */
+int
+timer_idle_exit (void)
+{
+  uint16_t count;
+  bool fired;
+  unsigned since;
+  int n, i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return 0;
+
+  count = pit_read_count (0, &fired);
+  if (fired)
+    {
+      /* The one-shot's interrupt is pending.  It will account for
+         the last tick and restart the periodic tick itself. */
+      n = oneshot_ticks - 1;
+    }
+  else
+    {
+      /* Count from the last tick boundary before the one-shot
+         started, PIT_TICK - oneshot_remaining cycles before it.
+         SINCE % PIT_TICK cycles of the current tick have passed,
+         so finish that tick with a one-shot of its own; its
+         interrupt restarts the periodic tick on the boundary. */
+      since = PIT_TICK - oneshot_remaining + (oneshot_count - count);
+      n = since / PIT_TICK;
+      oneshot_remaining = oneshot_count = PIT_TICK - since % PIT_TICK;
+      pit_start_oneshot (oneshot_count);
+    }
+  oneshot_ticks = 1;
+
+  /* No sleeper is due before the end of the one-shot, so only
+     the MLFQS bookkeeping needs to catch up. */
+  for (i = 0; i < n; i++)
+    mlfqs_update (ticks++);
+  return n;
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  mlfqs_update(timer_ticks());
-  thread_wakeup(timer_ticks());
-  ticks++;
-  thread_tick ();
+  int n = 1;
+
+  timer_irqs++;
+  if (oneshot_ticks != 0)
+    {
+      /* End of a one-shot: it ran up to a tick boundary N ticks
+         after the last one accounted for. */
+      n = oneshot_ticks;
+      oneshot_ticks = 0;
+      pit_configure_channel (0, 2, TIMER_FREQ);
+    }
+  while (n-- > 0)
+    {
+      mlfqs_update(ticks);
+      ticks++;
+      thread_tick ();
+    }
+  trace (TRACE_TICK, thread_current ()->tid, 0, ticks);
+  thread_wakeup(ticks);
+  workqueue_tick (ticks);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
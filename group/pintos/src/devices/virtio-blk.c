@@ -0,0 +1,406 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices, such as
+   QEMU's "-drive if=virtio", through the legacy virtio PCI
+   interface of [VIRTIO] 0.9.5, which QEMU's transitional
+   virtio-blk-pci device also offers.
+
+   Each device has a single ring (virtqueue) that holds up to
+   SLOT_CNT requests in flight at once, fewer if the ring is
+   small.  Each request uses a fixed chain of descriptors: a
+   header, one descriptor per block_request's buffer, and a
+   status byte.  A batch of adjacent block_requests thus goes to
+   the device as one scatter-gather request. */
+
+/* PCI IDs of a transitional virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio register offsets from the I/O port base. */
+#define REG_DEVICE_FEATURES 0x00        /* Device features (32 bits). */
+#define REG_GUEST_FEATURES 0x04         /* Driver features (32 bits). */
+#define REG_QUEUE_PFN 0x08              /* Ring page number (32 bits). */
+#define REG_QUEUE_SIZE 0x0c             /* Ring entries (16 bits). */
+#define REG_QUEUE_SELECT 0x0e           /* Ring to configure (16 bits). */
+#define REG_QUEUE_NOTIFY 0x10           /* Ring with news (16 bits). */
+#define REG_STATUS 0x12                 /* Device status (8 bits). */
+#define REG_ISR 0x13                    /* Interrupt status (8 bits). */
+#define REG_CAPACITY 0x14               /* Size in sectors (64 bits). */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01         /* Guest noticed the device. */
+#define STATUS_DRIVER 0x02              /* Guest has a driver for it. */
+#define STATUS_DRIVER_OK 0x04           /* Driver is ready. */
+#define STATUS_FAILED 0x80              /* Driver gave up. */
+
+/* Descriptor flags. */
+#define DESC_NEXT 0x01                  /* Chain continues at NEXT. */
+#define DESC_WRITE 0x02                 /* Device writes the buffer. */
+
+/* Request types and status. */
+#define REQ_IN 0                        /* Read. */
+#define REQ_OUT 1                       /* Write. */
+#define REQ_OK 0                        /* Success. */
+
+/* Legacy rings align the used ring to a page. */
+#define RING_ALIGN 4096
+
+/* Descriptors per request: header, data, status. */
+#define CHAIN_LEN (BLOCK_BATCH_MAX + 2)
+
+/* Most requests in flight per device, if the ring is big
+   enough. */
+#define SLOT_CNT 8
+
+/* A ring descriptor. */
+struct vring_desc
+  {
+    uint64_t addr;                      /* Physical address. */
+    uint32_t len;                       /* Length in bytes. */
+    uint16_t flags;                     /* DESC_* flags. */
+    uint16_t next;                      /* Next descriptor in chain. */
+  };
+
+/* A request header, read by the device. */
+struct req_header
+  {
+    uint32_t type;                      /* REQ_IN or REQ_OUT. */
+    uint32_t reserved;
+    uint64_t sector;                    /* First sector. */
+  };
+
+/* A request in flight. */
+struct slot
+  {
+    struct req_header header;           /* Read by device. */
+    uint8_t status;                     /* Written by device. */
+    struct block_request *batch[BLOCK_BATCH_MAX]; /* Requests. */
+    size_t cnt;                         /* Number of requests. */
+    struct semaphore *waiter;           /* Up'd on completion, or null
+                                           to block_complete() BATCH. */
+    bool in_use;                        /* Holds a request? */
+  };
+
+/* A virtio block device. */
+struct vblk
+  {
+    char name[8];                       /* Name, e.g. "vda". */
+    uint16_t io_base;                   /* Legacy register base. */
+    uint8_t irq;                        /* Interrupt vector. */
+    struct block *block;                /* Our block device. */
+
+    uint16_t size;                      /* Ring entries. */
+    struct vring_desc *desc;            /* Descriptor table. */
+    volatile uint16_t *avail;           /* Available ring: flags, idx,
+                                           ring[SIZE]. */
+    volatile uint16_t *used;            /* Used ring: flags, idx, then
+                                           SIZE (id, len) pairs. */
+    uint16_t last_used;                 /* Used entries handled. */
+
+    struct semaphore free_slots;        /* Counts unused SLOTS. */
+    size_t slot_cnt;                    /* Usable SLOTS. */
+    struct slot slots[SLOT_CNT];        /* Requests in flight. */
+  };
+
+/* Up to four devices, as with IDE. */
+#define VBLK_MAX 4
+static struct vblk *vblks[VBLK_MAX];
+static size_t vblk_cnt;
+
+static struct block_operations vblk_operations;
+
+static bool setup_device (struct vblk *, const struct pci_addr *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Finds and registers every virtio block device. */
+void
+virtio_blk_init (void)
+{
+  struct pci_addr a;
+
+  while (vblk_cnt < VBLK_MAX
+         && pci_find_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, vblk_cnt, &a))
+    {
+      struct vblk *v = calloc (1, sizeof *v);
+      uint32_t capacity;
+      char extra_info[64];
+      size_t i;
+
+      if (v == NULL)
+        PANIC ("Failed to allocate memory for virtio block device");
+      snprintf (v->name, sizeof v->name, "vd%c", 'a' + (int) vblk_cnt);
+      if (!setup_device (v, &a))
+        {
+          printf ("%s: device setup failed, ignoring\n", v->name);
+          free (v);
+          break;
+        }
+
+      /* Share an interrupt handler with any device on the same
+         line. */
+      for (i = 0; i < vblk_cnt; i++)
+        if (vblks[i]->irq == v->irq)
+          break;
+      if (i == vblk_cnt)
+        intr_register_ext (v->irq, interrupt_handler, "virtio-blk");
+      vblks[vblk_cnt++] = v;
+
+      /* Devices over 2 TB are cut off. */
+      capacity = (inl (v->io_base + REG_CAPACITY + 4) != 0 ? UINT32_MAX
+                  : inl (v->io_base + REG_CAPACITY));
+      snprintf (extra_info, sizeof extra_info,
+                "virtio, %zu requests in flight", v->slot_cnt);
+      v->block = block_register (v->name, BLOCK_RAW, extra_info, capacity,
+                                 &vblk_operations, v);
+      partition_scan (v->block);
+    }
+}
+
+/* Resets and configures the device at A for use as V.  Returns
+   true if successful, false on failure. */
+static bool
+setup_device (struct vblk *v, const struct pci_addr *a)
+{
+  size_t desc_size, avail_size, used_size, pages;
+  uint8_t *ring;
+  size_t i;
+
+  v->io_base = pci_io_bar (a, 0);
+  v->irq = (pci_read_config (a, PCI_REG_IRQ) & 0xff) + 0x20;
+  if (v->io_base == 0 || v->irq > 0x2f)
+    return false;
+  pci_enable_bus_master (a);
+
+  /* Reset, then announce ourselves.  We need no optional
+     features. */
+  outb (v->io_base + REG_STATUS, 0);
+  outb (v->io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (v->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (v->io_base + REG_GUEST_FEATURES, 0);
+
+  /* Lay out ring 0 in physically contiguous pages. */
+  outw (v->io_base + REG_QUEUE_SELECT, 0);
+  v->size = inw (v->io_base + REG_QUEUE_SIZE);
+  v->slot_cnt = v->size / CHAIN_LEN;
+  if (v->slot_cnt == 0)
+    goto fail;
+  if (v->slot_cnt > SLOT_CNT)
+    v->slot_cnt = SLOT_CNT;
+  desc_size = sizeof *v->desc * v->size;
+  avail_size = sizeof (uint16_t) * (3 + v->size);
+  used_size = sizeof (uint16_t) * 3 + sizeof (uint32_t) * 2 * v->size;
+  pages = (DIV_ROUND_UP (desc_size + avail_size, RING_ALIGN)
+           + DIV_ROUND_UP (used_size, RING_ALIGN));
+  ring = palloc_get_multiple (PAL_ZERO, pages);
+  if (ring == NULL)
+    goto fail;
+  v->desc = (struct vring_desc *) ring;
+  v->avail = (uint16_t *) (ring + desc_size);
+  v->used = (uint16_t *) (ring + ROUND_UP (desc_size + avail_size,
+                                           RING_ALIGN));
+  v->last_used = 0;
+
+  /* Chain each slot's descriptors together once and for all. */
+  sema_init (&v->free_slots, v->slot_cnt);
+  for (i = 0; i < v->slot_cnt; i++)
+    {
+      struct slot *s = &v->slots[i];
+      struct vring_desc *d = &v->desc[i * CHAIN_LEN];
+
+      s->in_use = false;
+      d[0].addr = vtop (&s->header);
+      d[0].len = sizeof s->header;
+      d[0].flags = DESC_NEXT;
+      d[0].next = i * CHAIN_LEN + 1;
+    }
+
+  outl (v->io_base + REG_QUEUE_PFN, vtop (ring) / RING_ALIGN);
+  outb (v->io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+
+ fail:
+  outb (v->io_base + REG_STATUS, STATUS_FAILED);
+  return false;
+}
+
+/* Sends the CNT requests in BATCH, which cover consecutive
+   sectors in the same direction, to V as one request.  Sleeps
+   until a slot is free.  If WAITER is non-null, ups it on
+   completion; otherwise, completes each request through the
+   block layer. */
+static void
+post (struct vblk *v, struct block_request **batch, size_t cnt,
+      struct semaphore *waiter)
+{
+  bool write = batch[0]->write;
+  struct vring_desc *d;
+  struct slot *s = NULL;
+  enum intr_level old_level;
+  size_t slot_no, i;
+  uint16_t idx;
+
+  ASSERT (cnt > 0 && cnt <= BLOCK_BATCH_MAX);
+
+  sema_down (&v->free_slots);
+  old_level = intr_disable ();
+  for (slot_no = 0; slot_no < v->slot_cnt; slot_no++)
+    if (!v->slots[slot_no].in_use)
+      break;
+  ASSERT (slot_no < v->slot_cnt);
+  s = &v->slots[slot_no];
+  s->in_use = true;
+  intr_set_level (old_level);
+
+  s->header.type = write ? REQ_OUT : REQ_IN;
+  s->header.reserved = 0;
+  s->header.sector = batch[0]->sector;
+  s->status = 0xff;
+  s->cnt = cnt;
+  s->waiter = waiter;
+
+  /* One data descriptor per request, then the status byte. */
+  d = &v->desc[slot_no * CHAIN_LEN];
+  for (i = 0; i < cnt; i++)
+    {
+      ASSERT (is_kernel_vaddr (batch[i]->buffer));
+      s->batch[i] = batch[i];
+      d[i + 1].addr = vtop (batch[i]->buffer);
+      d[i + 1].len = batch[i]->cnt * BLOCK_SECTOR_SIZE;
+      d[i + 1].flags = DESC_NEXT | (write ? 0 : DESC_WRITE);
+      d[i + 1].next = slot_no * CHAIN_LEN + i + 2;
+    }
+  d[cnt + 1].addr = vtop (&s->status);
+  d[cnt + 1].len = sizeof s->status;
+  d[cnt + 1].flags = DESC_WRITE;
+  d[cnt + 1].next = 0;
+
+  /* Publish the chain's head, then tell the device. */
+  old_level = intr_disable ();
+  idx = v->avail[1];
+  v->avail[2 + idx % v->size] = slot_no * CHAIN_LEN;
+  barrier ();
+  v->avail[1] = idx + 1;
+  barrier ();
+  outw (v->io_base + REG_QUEUE_NOTIFY, 0);
+  intr_set_level (old_level);
+}
+
+/* Block layer entry point: starts the CNT requests in BATCH. */
+static void
+vblk_start (void *v_, struct block_request **batch, size_t cnt)
+{
+  post (v_, batch, cnt, NULL);
+}
+
+/* Transfers CNT sectors starting at SECTOR between V_ and BUFFER
+   and waits for the transfer to finish. */
+static void
+vblk_transfer (void *v_, block_sector_t sector, size_t cnt, void *buffer,
+               bool write)
+{
+  struct block_request r, *rp = &r;
+  struct semaphore done;
+
+  ASSERT (!intr_context ());
+
+  block_request_init (&r, sector, cnt, buffer, write, NULL, NULL);
+  sema_init (&done, 0);
+  post (v_, &rp, 1, &done);
+  sema_down (&done);
+}
+
+static void
+vblk_read (void *v_, block_sector_t sector, void *buffer)
+{
+  vblk_transfer (v_, sector, 1, buffer, false);
+}
+
+static void
+vblk_write (void *v_, block_sector_t sector, const void *buffer)
+{
+  vblk_transfer (v_, sector, 1, (void *) buffer, true);
+}
+
+static void
+vblk_read_multi (void *v_, block_sector_t sector, size_t cnt, void *buffer)
+{
+  vblk_transfer (v_, sector, cnt, buffer, false);
+}
+
+static void
+vblk_write_multi (void *v_, block_sector_t sector, size_t cnt,
+                  const void *buffer)
+{
+  vblk_transfer (v_, sector, cnt, (void *) buffer, true);
+}
+
+static struct block_operations vblk_operations =
+  {
+    vblk_read,
+    vblk_write,
+    vblk_read_multi,
+    vblk_write_multi,
+    vblk_start,
+    NULL,
+    false
+  };
+
+/* Finishes every request that V has carried out since the last
+   call. */
+static void
+reap (struct vblk *v)
+{
+  while (v->last_used != v->used[1])
+    {
+      const volatile uint32_t *elem;
+      struct slot *s;
+      size_t i;
+
+      barrier ();
+      elem = (const volatile uint32_t *) (v->used + 2)
+             + 2 * (v->last_used % v->size);
+      s = &v->slots[*elem / CHAIN_LEN];
+      v->last_used++;
+
+      if (s->status != REQ_OK)
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu, v->name,
+               s->header.type == REQ_OUT ? "write" : "read",
+               (block_sector_t) s->header.sector);
+      if (s->waiter != NULL)
+        sema_up (s->waiter);
+      else
+        for (i = 0; i < s->cnt; i++)
+          block_complete (v->block, s->batch[i]);
+      s->in_use = false;
+      sema_up (&v->free_slots);
+    }
+}
+
+/* virtio-blk interrupt handler. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < vblk_cnt; i++)
+    {
+      struct vblk *v = vblks[i];
+      if (v->irq == f->vec_no && (inb (v->io_base + REG_ISR) & 1))
+        reap (v);
+    }
+}
@@ -0,0 +1,52 @@
+/* iostat.c
+
+   Prints I/O statistics for each block device named on the
+   command line. */
+
+#include <stdio.h>
+#include <syscall.h>
+
+static void print_latencies (const char *what, unsigned long long reqs,
+                             const uint64_t lat[]);
+
+int
+main (int argc, char *argv[])
+{
+  bool success = true;
+  int i;
+
+  for (i = 1; i < argc; i++)
+    {
+      struct blockstat s;
+      unsigned long long elapsed;
+
+      if (!blockstat (argv[i], &s))
+        {
+          printf ("%s: no such block device\n", argv[i]);
+          success = false;
+          continue;
+        }
+      elapsed = s.elapsed != 0 ? s.elapsed : 1;
+      printf ("%s: %llu bytes read, %llu bytes written\n",
+              argv[i], s.read_bytes, s.write_bytes);
+      print_latencies ("reads", s.read_reqs, s.read_lat);
+      print_latencies ("writes", s.write_reqs, s.write_lat);
+      printf ("  depth: %u now, %u max, %llu avg; busy %llu%%\n",
+              s.depth, s.max_depth, s.depth_time / elapsed,
+              s.busy_time * 100 / elapsed);
+    }
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* Prints histogram LAT, with a row for each nonzero bucket. */
+static void
+print_latencies (const char *what, unsigned long long reqs,
+                 const uint64_t lat[])
+{
+  int i;
+
+  printf ("  %s: %llu requests\n", what, reqs);
+  for (i = 0; i < BLOCKSTAT_BUCKETS; i++)
+    if (lat[i] != 0)
+      printf ("    >= 2**%-2d cycles: %llu\n", i, lat[i]);
+}
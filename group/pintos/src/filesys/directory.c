@@ -2,9 +2,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/file.h"
 #include "threads/malloc.h"
 #include "threads/thread.h"
@@ -19,21 +21,165 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
+/* A single directory entry, as stored on disk.
+
+   A directory is a sequence of sectors, each of which is split
+   into a chain of variable-length entries whose REC_LEN fields
+   add up to exactly BLOCK_SECTOR_SIZE, in the manner of ext2.
+   An entry only takes rec_size (NAME_LEN) bytes; whatever else
+   is in its REC_LEN is free space that dir_add() can split off
+   for a new entry.  Removing an entry merges its space into the
+   entry before it, so free space is never scattered across more
+   than one record per removal.
+
+   Entries in use never move within their sector, so the byte
+   offset that dir_readdir() and getdents keep as a position
+   still falls between the same entries after the directory
+   changes.  dir_add() therefore only splits or takes over free
+   space where it is, and never compacts a sector. */
 struct dir_entry
   {
-    block_sector_t inode_sector;        /* Sector number of header. */
-    char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
+    block_sector_t inode_sector;        /* Sector number of header,
+                                           0 if the entry is free. */
+    uint16_t rec_len;                   /* Bytes up to next entry. */
+    uint8_t name_len;                   /* Length of NAME. */
+    bool isdir;                         /* Does it name a directory? */
+    char name[];                        /* Not null terminated. */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* Returns the number of bytes that an entry with a NAME_LEN-byte
+   name occupies. */
+static inline size_t
+rec_size (size_t name_len)
+{
+  return ROUND_UP (sizeof (struct dir_entry) + name_len, 4);
+}
+
+/* Returns the entry at byte offset OFS within sector BLOCK. */
+static inline struct dir_entry *
+entry_at (uint8_t *block, size_t ofs)
+{
+  return (struct dir_entry *) (block + ofs);
+}
+
+/* Returns true if E is a sane entry at offset OFS within its
+   sector.  Anything else means the rest of the sector is
+   unreadable and is skipped. */
+static inline bool
+entry_valid (const struct dir_entry *e, size_t ofs)
+{
+  return (e->rec_len >= rec_size (0) && e->rec_len % 4 == 0
+          && ofs + e->rec_len <= BLOCK_SECTOR_SIZE
+          && (e->inode_sector == 0
+              || (e->name_len > 0 && e->name_len <= NAME_MAX
+                  && rec_size (e->name_len) <= e->rec_len)));
+}
+
+/* Returns true if E is in use and is named NAME, which is
+   LEN bytes long. */
+static inline bool
+entry_is (const struct dir_entry *e, const char *name, size_t len)
+{
+  return (e->inode_sector != 0 && e->name_len == len
+          && !memcmp (e->name, name, len));
+}
+
+/* Reads the sector at byte offset OFS of DIR into BLOCK.
+   Returns false at end of directory. */
+static bool
+read_block (const struct dir *dir, off_t ofs, uint8_t *block)
+{
+  return inode_read_at (dir->inode, block, BLOCK_SECTOR_SIZE, ofs)
+         == BLOCK_SECTOR_SIZE;
+}
+
+/* Writes BLOCK back as the sector at byte offset OFS of DIR. */
+static bool
+write_block (struct dir *dir, off_t ofs, const uint8_t *block)
+{
+  return inode_write_at (dir->inode, block, BLOCK_SECTOR_SIZE, ofs)
+         == BLOCK_SECTOR_SIZE;
+}
+
+/* Stores an entry for NAME, LEN bytes long, naming INODE_SECTOR
+   into BLOCK if some record in it has enough free space, without
+   moving any entry in use.  Returns true if successful, false if
+   BLOCK is too full. */
+static bool
+block_insert (uint8_t *block, const char *name, size_t len,
+              block_sector_t inode_sector, bool isdir)
+{
+  size_t need = rec_size (len);
+  size_t ofs;
+
+  for (ofs = 0; ofs < BLOCK_SECTOR_SIZE; )
+    {
+      struct dir_entry *e = entry_at (block, ofs);
+      struct dir_entry *new;
+      size_t used;
+
+      if (!entry_valid (e, ofs))
+        break;
+      used = e->inode_sector != 0 ? rec_size (e->name_len) : 0;
+      if (e->rec_len - used >= need)
+        {
+          /* Split E, or take it over if it is free. */
+          new = entry_at (block, ofs + used);
+          new->rec_len = e->rec_len - used;
+          if (used != 0)
+            e->rec_len = used;
+          new->inode_sector = inode_sector;
+          new->name_len = len;
+          new->isdir = isdir;
+          memcpy (new->name, name, len);
+          return true;
+        }
+      ofs += e->rec_len;
+    }
+  return false;
+}
+
+/* Frees the entry at offset OFS in BLOCK, merging its space into
+   the entry before it, or marking it free if it is the first
+   entry in BLOCK.  A free entry that follows is merged as well. */
+static void
+block_remove (uint8_t *block, size_t ofs)
+{
+  struct dir_entry *e = entry_at (block, ofs);
+  struct dir_entry *next;
+  size_t prev = 0, cur = 0;
+
+  /* Absorb a free entry that follows. */
+  if (ofs + e->rec_len < BLOCK_SECTOR_SIZE)
+    {
+      next = entry_at (block, ofs + e->rec_len);
+      if (next->inode_sector == 0 && entry_valid (next, ofs + e->rec_len))
+        e->rec_len += next->rec_len;
+    }
+
+  if (ofs == 0)
+    {
+      e->inode_sector = 0;
+      return;
+    }
+
+  /* Find the entry before E and hand E's space over to it. */
+  while (cur != ofs)
+    {
+      prev = cur;
+      cur += entry_at (block, cur)->rec_len;
+    }
+  entry_at (block, prev)->rec_len += e->rec_len;
+}
+
+/* Creates an empty directory in the given SECTOR, whose ".." is
+   the directory in sector PARENT.  The directory grows a sector
+   at a time as entries are added.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, block_sector_t parent)
 {
-  return inode_create_real (sector,
-          entry_cnt * sizeof (struct dir_entry), true);
+  return inode_create_dir (sector, 0, parent);
 }
 
 /* Opens and returns the directory for the given INODE, of which
@@ -91,31 +237,51 @@ dir_get_inode (struct dir *dir)
 }
 
 /* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   If successful, returns true, sets *SECTORP to the sector of
+   the file's inode if SECTORP is non-null, and sets *OFSP to the
+   byte offset of the directory entry if OFSP is non-null.
+   otherwise, returns false and ignores SECTORP and OFSP. */
 static bool
 lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp)
+        block_sector_t *sectorp, off_t *ofsp)
 {
-  struct dir_entry e;
-  size_t ofs;
+  size_t len = strlen (name);
+  uint8_t *block;
+  off_t block_ofs;
+  bool found = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (e.in_use && !strcmp (name, e.name))
-      {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
-      }
-  return false;
+  if (len == 0 || len > NAME_MAX)
+    return false;
+  block = malloc (BLOCK_SECTOR_SIZE);
+  if (block == NULL)
+    return false;
+
+  for (block_ofs = 0; !found && read_block (dir, block_ofs, block);
+       block_ofs += BLOCK_SECTOR_SIZE)
+    {
+      size_t ofs = 0;
+      while (ofs < BLOCK_SECTOR_SIZE)
+        {
+          struct dir_entry *e = entry_at (block, ofs);
+          if (!entry_valid (e, ofs))
+            break;
+          if (entry_is (e, name, len))
+            {
+              if (sectorp != NULL)
+                *sectorp = e->inode_sector;
+              if (ofsp != NULL)
+                *ofsp = block_ofs + ofs;
+              found = true;
+              break;
+            }
+          ofs += e->rec_len;
+        }
+    }
+  free (block);
+  return found;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -126,13 +292,13 @@ bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode)
 {
-  struct dir_entry e;
+  block_sector_t sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  if (lookup (dir, name, &sector, NULL))
+    *inode = inode_open (sector);
   else
     *inode = NULL;
 
@@ -141,120 +307,346 @@ dir_lookup (const struct dir *dir, const char *name,
 
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
-   INODE_SECTOR.
+   INODE_SECTOR, and ISDIR tells whether it is a directory.
    Returns true if successful, false on failure.
    Fails if NAME is invalid (i.e. too long) or a disk or memory
    error occurs. */
 bool
-dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
+dir_add (struct dir *dir, const char *name, block_sector_t inode_sector,
+         bool isdir)
 {
-  struct dir_entry e;
-  off_t ofs;
+  size_t len;
+  uint8_t *block = NULL;
+  off_t block_ofs;
   bool success = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Check NAME for validity. */
-  if (*name == '\0' || strlen (name) > NAME_MAX)
+  len = strlen (name);
+  if (len == 0 || len > NAME_MAX)
     return false;
 
   /* Check that NAME is not in use. */
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  block = malloc (BLOCK_SECTOR_SIZE);
+  if (block == NULL)
+    goto done;
 
+  /* Use the first sector with room for the entry.
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (!e.in_use)
-      break;
+  for (block_ofs = 0; read_block (dir, block_ofs, block);
+       block_ofs += BLOCK_SECTOR_SIZE)
+    if (block_insert (block, name, len, inode_sector, isdir))
+      {
+        success = write_block (dir, block_ofs, block);
+        goto done;
+      }
 
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* No room anywhere, so grow DIR by one empty sector. */
+  entry_at (block, 0)->inode_sector = 0;
+  entry_at (block, 0)->rec_len = BLOCK_SECTOR_SIZE;
+  success = (block_insert (block, name, len, inode_sector, isdir)
+             && write_block (dir, block_ofs, block));
 
  done:
+  free (block);
   return success;
 }
 
-bool
-dir_isempty(struct dir *dir)
+/* Returns true if DIR contains no entries. */
+static bool
+dir_isempty (struct dir *dir)
 {
-  off_t ofs;
-  struct dir_entry e;
+  struct dirent ent;
+  off_t pos = 0;
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e)
-    if (e.in_use)
-        return false;
-  return true;
+  return dir_getdents (dir, &pos, &ent, 1) == 0;
 }
 
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME,
+   or if it is a directory that is not empty. */
 bool
 dir_remove (struct dir *dir, const char *name)
 {
-  struct dir_entry e;
   struct inode *inode = NULL;
+  uint8_t *block = NULL;
+  block_sector_t sector;
   bool success = false;
-  off_t ofs;
+  off_t ofs, block_ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &sector, &ofs))
     goto done;
 
   /* Open inode. */
-  inode = inode_open (e.inode_sector);
+  inode = inode_open (sector);
   if (inode == NULL)
     goto done;
 
+  /* Only empty directories can be removed. */
+  if (inode->data.isdir)
+    {
+      struct dir victim = { inode, 0 };
+      if (!dir_isempty (&victim))
+        goto done;
+    }
+
   /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e)
+  block = malloc (BLOCK_SECTOR_SIZE);
+  if (block == NULL)
+    goto done;
+  block_ofs = ofs - ofs % BLOCK_SECTOR_SIZE;
+  if (!read_block (dir, block_ofs, block))
+    goto done;
+  block_remove (block, ofs - block_ofs);
+  if (!write_block (dir, block_ofs, block))
     goto done;
-
-  if (inode->data.isdir && !dir_isempty(dir_open(inode)))
-      goto done;
 
   /* Remove inode. */
   inode_remove (inode);
   success = true;
 
  done:
+  free (block);
   inode_close (inode);
   return success;
 }
 
+/* Finds the first entry in use at byte offset *POSP or later in
+   DIR, copies it into E (which needs room for NAME_MAX bytes of
+   name), and advances *POSP just past it.  BLOCK caches the
+   sector at offset *LOADEDP between calls; set *LOADEDP to -1
+   before the first call.  *POSP need not point at the start of
+   an entry.  Because entries in use never move, entries that
+   were past *POSP are still returned after the directory
+   changes, while entries added before *POSP are not.  Returns
+   false once the end of DIR is reached. */
+static bool
+next_entry (const struct dir *dir, uint8_t *block, off_t *loadedp,
+            off_t *posp, struct dir_entry *e)
+{
+  for (;;)
+    {
+      off_t block_ofs = *posp - *posp % BLOCK_SECTOR_SIZE;
+      size_t ofs = 0;
+
+      if (block_ofs != *loadedp)
+        {
+          if (!read_block (dir, block_ofs, block))
+            return false;
+          *loadedp = block_ofs;
+        }
+
+      while (ofs < BLOCK_SECTOR_SIZE)
+        {
+          struct dir_entry *cur = entry_at (block, ofs);
+          if (!entry_valid (cur, ofs))
+            break;
+          if (block_ofs + (off_t) ofs >= *posp && cur->inode_sector != 0)
+            {
+              memcpy (e, cur, rec_size (cur->name_len));
+              *posp = block_ofs + ofs + cur->rec_len;
+              return true;
+            }
+          ofs += cur->rec_len;
+        }
+      *posp = block_ofs + BLOCK_SECTOR_SIZE;
+    }
+}
+
 /* Reads the next directory entry in DIR and stores the name in
    NAME.  Returns true if successful, false if the directory
    contains no more entries. */
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
-  struct dir_entry e;
+  struct dirent ent;
+
+  if (dir_getdents (dir, &dir->pos, &ent, 1) == 0)
+    return false;
+  strlcpy (name, ent.d_name, NAME_MAX + 1);
+  return true;
+}
+
+/* Stores up to CNT in-use entries of DIR into ENTS, starting at
+   byte offset *POS in DIR, and advances *POS past the last entry
+   stored.  Each sector of DIR is read once no matter how many
+   entries it holds.  Returns the number of entries stored, which
+   is 0 once the end of DIR is reached. */
+size_t
+dir_getdents (struct dir *dir, off_t *pos, struct dirent *ents, size_t cnt)
+{
+  uint8_t *block;
+  off_t loaded = -1;
+  size_t stored = 0;
+  union
+    {
+      struct dir_entry e;
+      char buf[sizeof (struct dir_entry) + NAME_MAX + 4];
+    }
+  u;
+
+  ASSERT (dir != NULL);
+  ASSERT (pos != NULL);
+
+  block = malloc (BLOCK_SECTOR_SIZE);
+  if (block == NULL)
+    return 0;
+  while (stored < cnt && next_entry (dir, block, &loaded, pos, &u.e))
+    {
+      struct dirent *d = &ents[stored++];
+      d->d_ino = u.e.inode_sector;
+      d->d_isdir = u.e.isdir;
+      memcpy (d->d_name, u.e.name, u.e.name_len);
+      d->d_name[u.e.name_len] = '\0';
+    }
+  free (block);
+  return stored;
+}
+
+/* Extracts a file name part from *SRCP into PART, and updates
+   *SRCP so that the next call will return the next file name
+   part.  Returns 1 if successful, 0 at end of string, -1 for a
+   too-long file name part. */
+static int
+get_next_part (char part[NAME_MAX + 1], const char **srcp)
+{
+  const char *src = *srcp;
+  char *dst = part;
+
+  /* Skip leading slashes.  If it's all slashes, we're done. */
+  while (*src == '/')
+    src++;
+  if (*src == '\0')
+    return 0;
+
+  /* Copy up to NAME_MAX characters from SRC to DST.  Add null
+     terminator. */
+  while (*src != '/' && *src != '\0')
+    {
+      if (dst < part + NAME_MAX)
+        *dst++ = *src;
+      else
+        return -1;
+      src++;
+    }
+  *dst = '\0';
+
+  /* Advance source pointer. */
+  *srcp = src;
+  return 1;
+}
+
+/* Replaces DIR's inode by the inode in SECTOR, which must be a
+   directory.  Returns false, leaving DIR untouched, if SECTOR
+   cannot be opened or is not a directory. */
+static bool
+step_into (struct dir *dir, block_sector_t sector)
+{
+  struct inode *inode = inode_open (sector);
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e)
+  if (inode == NULL)
+    return false;
+  if (!inode->data.isdir)
+    {
+      inode_close (inode);
+      return false;
+    }
+  inode_close (dir->inode);
+  dir->inode = inode;
+  return true;
+}
+
+/* Walks PATH component by component starting from the directory
+   open in DIR, following "." and ".." through the parent link of
+   each directory.  Every component but the last must name a
+   directory; the last one is copied into NAME, or NAME is left
+   empty if PATH ends at a directory ("/", "." or ".."), in which
+   case DIR is that directory.  On failure DIR still holds an
+   open inode, which the caller must close. */
+static bool
+walk (struct dir *dir, const char *path, char name[NAME_MAX + 1])
+{
+  char part[NAME_MAX + 1];
+  block_sector_t sector;
+  int result;
+
+  name[0] = '\0';
+  while ((result = get_next_part (part, &path)) > 0)
     {
-      dir->pos += sizeof e;
-      if (e.in_use)
+      /* The previous component had more after it, so it must be
+         a directory to descend into. */
+      if (name[0] != '\0')
         {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
+          if (!lookup (dir, name, &sector, NULL)
+              || !step_into (dir, sector))
+            return false;
+          name[0] = '\0';
         }
+
+      if (!strcmp (part, "."))
+        continue;
+      else if (!strcmp (part, ".."))
+        {
+          if (!step_into (dir, dir->inode->data.parent))
+            return false;
+        }
+      else
+        strlcpy (name, part, NAME_MAX + 1);
+    }
+  return result == 0;
+}
+
+/* Resolves PATH, which is relative to the current working
+   directory unless it begins with "/", without copying it.
+   On success, returns true, stores the directory containing the
+   final component of PATH in *DIRP, which the caller must
+   close, and copies that component into NAME.  NAME is left
+   empty if PATH itself names a directory through "/", "." or
+   "..", in which case *DIRP is that directory.
+   Fails if PATH is empty, has a component longer than NAME_MAX,
+   passes through something that is not an existing directory,
+   or starts or ends in a directory that has been removed. */
+bool
+dir_resolve (const char *path, struct dir **dirp, char name[NAME_MAX + 1])
+{
+  struct thread *cur = thread_current ();
+  struct dir dir;
+
+  *dirp = NULL;
+  if (*path == '\0')
+    return false;
+
+  /* Relative paths start from the working directory. */
+  if (*path != '/' && cur->cwd != NULL)
+    dir.inode = inode_reopen (cur->cwd->inode);
+  else
+    dir.inode = inode_open (ROOT_DIR_SECTOR);
+  dir.pos = 0;
+  if (dir.inode == NULL)
+    return false;
+  if (dir.inode->removed)
+    goto done;
+
+  if (walk (&dir, path, name) && !dir.inode->removed)
+    {
+      *dirp = dir_open (dir.inode);
+      return *dirp != NULL;
     }
+
+ done:
+  inode_close (dir.inode);
   return false;
 }
 
@@ -345,131 +737,55 @@ done:
     return success;
 }
 
-// Check if given path of directory exist
-struct dir*
-get_dir_by_path(const char *path)
-{
-    struct inode *dir_inode;
-    struct dir *dir = dir_open_root();
-    struct dir *return_dir = NULL;
-    struct dir_entry next_dir_entry;
-    off_t next_dir_ofs;
-    char *fname;
-    size_t i, j;
-    char c;
-    
-    j = 0;
-    fname = malloc(sizeof(char) * NAME_MAX);
-    memset(fname, 0, sizeof(char) * NAME_MAX);
-    for (i = 1; i < strlen(path) ; i++)
-    {
-        c = *(path + i);
-        if (c == '/') {
-            *(fname + j) = '\0';
-            if (lookup(dir, fname, &next_dir_entry,
-                        &next_dir_ofs)) {
-                dir_close(dir);
-                dir_inode = inode_open(next_dir_entry.inode_sector);
-                dir = dir_open(dir_inode);
-                j = 0;
-            }
-            else {
-                dir_close(dir);
-                goto done;
-            }
-        }
-        else {
-            *(fname + j) = c;
-            j++;
-        }
-    }
-    return_dir = dir;
-
-done:
-    free(fname);
-    return return_dir;
-}
-
-void
-to_abs(char *path)
-{
-    struct thread *cur = thread_current();
-    size_t cwd_len = strlen(cur->cwd);
-    char *buff = malloc(sizeof(char) * PATH_MAX);
-
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memcpy(buff, path, strlen(path));
-    if (*path != '/') {
-        memcpy(path, cur->cwd, strlen(cur->cwd) + 1);
-        strlcat(path, buff, strlen(path) + strlen(buff) + 1);
-    }
-    free(buff);
-}
-
 bool
 dir_chdir (const char *path)
 {
-    char *buff;
+    char name[NAME_MAX + 1];
     struct thread *cur = thread_current();
-    bool success = false;
     struct dir *dir = NULL;
+    struct inode *inode = NULL;
 
-    buff = malloc(sizeof(char) * PATH_MAX);
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memcpy(buff, path, strlen(path));
-    to_abs(buff);
-    if (simplify_path(buff)
-            && (dir = get_dir_by_path(buff)) != NULL) {
-        success = true;
-        memcpy(cur->cwd, buff, PATH_MAX);
+    if (!dir_resolve(path, &dir, name))
+        return false;
+    // step into the final component, which must be a directory
+    if (name[0] != '\0') {
+        dir_lookup(dir, name, &inode);
+        dir_close(dir);
+        if (inode == NULL || !inode->data.isdir) {
+            inode_close(inode);
+            return false;
+        }
+        if ((dir = dir_open(inode)) == NULL)
+            return false;
     }
-    dir_close(dir);
-    free(buff);
-    return success;
+    dir_close(cur->cwd);
+    cur->cwd = dir;
+    return true;
 }
 
 bool
 dir_mkdir(const char *path)
 {
-    if (*path == '\0')
-        return false;
-    char *buff;
-    char *parent_dir_path;
-    char *dirname;
-    struct dir *parent;
+    char dirname[NAME_MAX + 1];
+    struct dir *parent = NULL;
     bool success = false;
-    block_sector_t dirsector;
+    block_sector_t dirsector = 0;
 
-    buff = malloc(sizeof(char) * PATH_MAX);
-    parent_dir_path = malloc(sizeof(char) * PATH_MAX);
-    dirname = malloc(sizeof(char) * NAME_MAX);
-    memset(dirname, 0, sizeof(char) * NAME_MAX);
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memset(parent_dir_path, 0, sizeof(char) * PATH_MAX);
-    memcpy(buff, path, strlen(path));
-    to_abs(buff);
-    if (!simplify_path(buff))
-        goto done;
-    memcpy(parent_dir_path, buff, strlen(buff));
-    if (!to_dir_path(parent_dir_path))
+    journal_begin();
+    if (!dir_resolve(path, &parent, dirname) || dirname[0] == '\0')
         goto done;
-    if ((parent = get_dir_by_path(parent_dir_path)) == NULL)
-        goto done;
-    memcpy(dirname, buff + strlen(parent_dir_path),
-            strlen(buff) - strlen(parent_dir_path) - 1);
     if (lookup(parent, dirname, NULL, NULL))
         goto done;
-    if (!free_map_allocate(1, &dirsector) ||
-            !dir_create(dirsector, 16))
-        goto done;
-    dir_add(parent, dirname, dirsector);
-    success = true;
+    if (free_map_allocate(1, &dirsector)
+            && dir_create(dirsector, inode_get_inumber(parent->inode))
+            && dir_add(parent, dirname, dirsector, true))
+        success = true;
+    else if (dirsector != 0)
+        free_map_release(dirsector, 1);
 
 done:
-    free(buff);
-    free(parent_dir_path);
     dir_close(parent);
-    free(dirname);
+    journal_end();
     return success;
 }
 
@@ -488,6 +804,21 @@ readdir(int fd, char *name)
     return dir_readdir(ffd->dir, name);  
 }
 
+int
+getdents(int fd, struct dirent *ents, unsigned cnt, unsigned *cookie)
+{
+    struct file_fd *ffd = NULL;
+    off_t pos = *cookie;
+    size_t stored;
+
+    get_filefd_from_fd(fd, &ffd);
+    if (ffd == NULL || ffd->dir == NULL)
+        return -1;
+    stored = dir_getdents(ffd->dir, &pos, ents, cnt);
+    *cookie = pos;
+    return stored;
+}
+
 bool
 dir_isdir(int fd)
 {
@@ -3,7 +3,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <dirent.h>
 #include "devices/block.h"
+#include "filesys/off_t.h"
 
 /* Maximum length of a file name component.
    This is the traditional UNIX maximum length.
@@ -15,7 +17,7 @@
 struct inode;
 
 /* Opening and closing directories. */
-bool dir_create (block_sector_t sector, size_t entry_cnt);
+bool dir_create (block_sector_t sector, block_sector_t parent);
 struct dir *dir_open (struct inode *);
 struct dir *dir_open_root (void);
 struct dir *dir_reopen (struct dir *);
@@ -24,15 +26,17 @@ struct inode *dir_get_inode (struct dir *);
 
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
-bool dir_add (struct dir *, const char *name, block_sector_t);
+bool dir_add (struct dir *, const char *name, block_sector_t, bool isdir);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_getdents (struct dir *, off_t *pos, struct dirent *, size_t cnt);
+int getdents (int fd, struct dirent *, unsigned cnt, unsigned *cookie);
+
+/* Path resolution. */
+bool dir_resolve (const char *path, struct dir **, char name[NAME_MAX + 1]);
 bool dir_chdir (const char *dir);
 bool dir_mkdir (const char *dir);
 bool simplify_path(char *);
-
-struct dir* get_dir_by_path(const char *);
 bool to_dir_path(char *);
-void to_abs(char *);
 
 #endif /* filesys/directory.h */
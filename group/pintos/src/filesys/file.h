@@ -11,6 +11,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool direct;                /* Bypass the buffer cache? */
   };
 
 
@@ -33,6 +34,10 @@ off_t file_write_at (struct file *, const void *, off_t size, off_t start);
 void file_deny_write (struct file *);
 void file_allow_write (struct file *);
 
+/* Uncached I/O. */
+void file_set_direct (struct file *, bool);
+bool file_is_direct (struct file *);
+
 /* File position. */
 void file_seek (struct file *, off_t);
 off_t file_tell (struct file *);
@@ -5,8 +5,9 @@
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/page-cache.h"
 #include "filesys/directory.h"
-#include "filesys/path.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
@@ -24,6 +25,7 @@ filesys_init (bool format)
 
   inode_init ();
   free_map_init ();
+  journal_init (format);
 
   if (format)
     do_format ();
@@ -36,7 +38,10 @@ filesys_init (bool format)
 void
 filesys_done (void)
 {
+  inode_done ();
+  page_cache_flush ();
   free_map_close ();
+  journal_done ();
 }
 
 /* Creates a file named NAME with the given INITIAL_SIZE.
@@ -46,45 +51,35 @@ filesys_done (void)
 bool
 filesys_create (const char *path, off_t initial_size)
 {
-    // check path length
-    if (strlen(path) >= PATH_MAX)
-        return false;
-    char *buff = malloc(sizeof(char) * PATH_MAX);
     char fname[NAME_MAX + 1];
     struct dir *dir = NULL;
     block_sector_t inode_sector = 0;
     bool success = false;
 
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memcpy(buff, path, strlen(path));
-    to_abs(buff);
-    if (simplify_path(buff)) {
-        path_basename(buff, fname);
-        if (to_dir_path(buff)
-                && (dir = get_dir_by_path(buff)) != NULL
-                && free_map_allocate(1, &inode_sector)
-                && inode_create(inode_sector, initial_size)
-                && dir_add(dir, fname, inode_sector))
-        {
-            success = true;
-        }
+    journal_begin();
+    if (dir_resolve(path, &dir, fname)
+            && free_map_allocate(1, &inode_sector)
+            && inode_create(inode_sector, 0)
+            && dir_add(dir, fname, inode_sector, false))
+    {
+        success = true;
     }
     if (inode_sector != 0 && success == false)
         free_map_release(inode_sector, 1);
     dir_close(dir);
-    free(buff);
+    journal_end();
+
+    // grow the new file to its initial size in steps of its own,
+    // which one operation could not log; as before, a file the
+    // disk cannot fill is still created, only shorter
+    if (success && initial_size > 0) {
+        struct inode *inode = inode_open(inode_sector);
+
+        if (inode != NULL)
+            inode_grow(inode, initial_size);
+        inode_close(inode);
+    }
     return success;
-  // block_sector_t inode_sector = 0;
-  // struct dir *dir = dir_open_root ();
-  // bool success = (dir != NULL
-  //                 && free_map_allocate (1, &inode_sector)
-  //                 && inode_create (inode_sector, initial_size)
-  //                 && dir_add (dir, name, inode_sector));
-  // if (!success && inode_sector != 0)
-  //   free_map_release (inode_sector, 1);
-  // dir_close (dir);
-
-  // return success;
 }
 
 /* Opens the file with the given NAME.
@@ -95,55 +90,30 @@ filesys_create (const char *path, off_t initial_size)
 struct file *
 filesys_open (const char *path)
 {
-    char fname[NAME_MAX];
-    char *buff = malloc(sizeof(char) * PATH_MAX);
-    char *dir_path = malloc(sizeof(char) * PATH_MAX);
+    char fname[NAME_MAX + 1];
+
+    return filesys_open_name(path, fname);
+}
+
+/* Opens the file with the given PATH, as filesys_open(), and
+   copies the final component that PATH resolved to into NAME,
+   which must have room for NAME_MAX + 1 bytes.  NAME is left
+   empty if PATH names a directory through "/", "." or "..". */
+struct file *
+filesys_open_name (const char *path, char *name)
+{
     struct dir *dir = NULL;
     struct inode *inode = NULL;
 
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memset(dir_path, 0, sizeof(char) * PATH_MAX);
-    memset(fname, 0, NAME_MAX);
-    // if it's relative path, check cwd exist or not
-    if (*(path) == '.' && *(path + 1) == '.') {
-        buff[0] = '.';
-        to_abs(buff);
-        if (simplify_path(buff) && get_dir_by_path(buff) == NULL)
-            goto done;
-    }
-    else if (*path == '\0') {
-        goto done;
+    if (dir_resolve(path, &dir, name)) {
+        // path names a directory by itself ("/", "." or "..")
+        if (name[0] == '\0')
+            inode = inode_reopen(dir_get_inode(dir));
+        else
+            dir_lookup(dir, name, &inode);
     }
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memcpy(buff, path, strlen(path));
-    to_abs(buff);
-    if (simplify_path(buff))
-    {
-        memcpy(dir_path, buff, strlen(buff));
-        if (strcmp(buff, "/") == 0) {
-            dir = dir_open_root();
-            inode = dir_get_inode(dir);
-        }
-        else if (to_dir_path(dir_path)
-                && (dir = get_dir_by_path(dir_path)) != NULL) {
-            path_basename(buff, fname);
-            dir_lookup(dir, fname, &inode);
-            dir_close(dir);
-        }
-    }
-
-done:
-    free(dir_path);
-    free(buff);
+    dir_close(dir);
     return file_open(inode);
-  // struct dir *dir = dir_open_root ();
-  // struct inode *inode = NULL;
-
-  // if (dir != NULL)
-  //   dir_lookup (dir, name, &inode);
-  // dir_close (dir);
-
-  // return file_open (inode);
 }
 
 /* Deletes the file named NAME.
@@ -153,36 +123,16 @@ done:
 bool
 filesys_remove (const char *path)
 {
-    char fname[NAME_MAX];
-    char *buff = malloc(sizeof(char) * PATH_MAX);
-    char *dir_path = malloc(sizeof(char) * PATH_MAX);
+    char fname[NAME_MAX + 1];
     struct dir *dir = NULL;
     bool success = false;
 
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memset(dir_path, 0, sizeof(char) * PATH_MAX);
-    memset(fname, 0, NAME_MAX);
-    memcpy(buff, path, strlen(path));
-    to_abs(buff);
-    if (simplify_path(buff))
-    {
-        memcpy(dir_path, buff, strlen(buff));
-        if (to_dir_path(dir_path)
-                && (dir = get_dir_by_path(dir_path)) != NULL) {
-            path_basename(buff, fname);
-            success = dir_remove(dir, fname);
-        }
-    }
+    journal_begin();
+    if (dir_resolve(path, &dir, fname) && fname[0] != '\0')
+        success = dir_remove(dir, fname);
     dir_close(dir);
-    free(dir_path);
-    free(buff);
+    journal_end();
     return success;
-
-  // struct dir *dir = dir_open_root ();
-  // bool success = dir != NULL && dir_remove (dir, name);
-  // dir_close (dir);
-
-  // return success;
 }
 
 /* Formats the file system. */
@@ -191,8 +141,9 @@ do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
+  journal_flush ();
   printf ("done.\n");
 }
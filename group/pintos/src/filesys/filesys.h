@@ -7,6 +7,7 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Metadata journal header sector. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
@@ -15,6 +16,7 @@ void filesys_init (bool format);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size);
 struct file *filesys_open (const char *name);
+struct file *filesys_open_name (const char *path, char *name);
 bool filesys_remove (const char *name);
 
 #endif /* filesys/filesys.h */
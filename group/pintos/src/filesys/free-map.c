@@ -4,19 +4,31 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors that are in use or cannot be reused yet: free_map plus
+   the sectors freed by transactions the journal has not yet
+   checkpointed.  free_map is what goes to disk; this is what
+   allocation consults. */
+static struct bitmap *busy_map;
+
 /* Initializes the free map. */
 void
 free_map_init (void)
 {
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  busy_map = bitmap_create (block_size (fs_device));
+  if (free_map == NULL || busy_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
+  bitmap_mark (busy_map, FREE_MAP_SECTOR);
+  bitmap_mark (busy_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (busy_map, JOURNAL_SECTOR, JOURNAL_SECTORS, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
@@ -27,26 +39,52 @@ free_map_init (void)
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector = bitmap_scan_and_flip (busy_map, 0, cnt, false);
+  if (sector == BITMAP_ERROR)
+    {
+      /* Sectors freed by committed transactions are held back
+         until the journal checkpoints them, so do that and
+         retry.  The running transaction is left alone. */
+      journal_checkpoint ();
+      sector = bitmap_scan_and_flip (busy_map, 0, cnt, false);
+    }
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false);
-      sector = BITMAP_ERROR;
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      if (free_map_file != NULL && !bitmap_write (free_map, free_map_file))
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false);
+          bitmap_set_multiple (busy_map, sector, cnt, false);
+          sector = BITMAP_ERROR;
+        }
     }
   if (sector != BITMAP_ERROR)
     *sectorp = sector;
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Frees CNT sectors starting at SECTOR in the free map, as part
+   of the running journal transaction.  The sectors become
+   available for reuse once that transaction has been
+   checkpointed. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
   ASSERT (bitmap_all (free_map, sector, cnt));
   bitmap_set_multiple (free_map, sector, cnt, false);
   bitmap_write (free_map, free_map_file);
+  journal_release (sector, cnt);
+}
+
+/* Makes CNT sectors starting at SECTOR, freed earlier by
+   free_map_release(), available for use.  Called by the journal
+   once the transaction that freed them has been checkpointed. */
+void
+free_map_reclaim (block_sector_t sector, size_t cnt)
+{
+  ASSERT (bitmap_all (busy_map, sector, cnt));
+  ASSERT (bitmap_none (free_map, sector, cnt));
+  bitmap_set_multiple (busy_map, sector, cnt, false);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -56,7 +94,8 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!bitmap_read (free_map, free_map_file)
+      || !bitmap_read (busy_map, free_map_file))
     PANIC ("can't read free map");
 }
 
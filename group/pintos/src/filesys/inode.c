@@ -5,17 +5,23 @@
 #include "filesys/filesys.h"
 #include "filesys/cache.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/page-cache.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
-void inode_read_ahead(void *aux);
+
+void inode_read_ahead(struct work *w);
 bool inode_extend(struct inode *inode, off_t size);
 void inode_free(struct inode *inode);
-bool inode_create_real(block_sector_t sector, off_t length,
-        bool isdir);
+static bool inode_create_real(block_sector_t sector, off_t length,
+        bool isdir, block_sector_t parent);
 
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
@@ -46,7 +52,7 @@ byte_to_sector (const struct inode *inode, off_t pos)
   // Load level 1 buffer
   if (i >= 12) {
     block_sector_t level1_idx = inode->data.blocks[12];
-    block_read(fs_device, level1_idx, buffer);
+    journal_read(level1_idx, buffer);
   }
   if (pos >= inode->data.length)
       retval = -1;
@@ -64,7 +70,7 @@ byte_to_sector (const struct inode *inode, off_t pos)
   {
     level2_ofs = (i - 12 - 64) % 128;
     level1_ofs = (i - 12 - 64) / 128 + 64;
-    block_read(fs_device, buffer[level1_ofs], buffer2);
+    journal_read(buffer[level1_ofs], buffer2);
     retval = (block_sector_t) buffer2[level2_ofs];
   }
   free(buffer);
@@ -76,22 +82,52 @@ byte_to_sector (const struct inode *inode, off_t pos)
   //  return -1;
 }
 
+/* Returns true if INODE's contents are file system metadata,
+   which must only be written through the journal. */
+static inline bool
+inode_is_metadata (const struct inode *inode)
+{
+  return inode->data.isdir || inode->sector == FREE_MAP_SECTOR;
+}
+
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* Work queue that runs read-ahead, and its number of workers. */
+#define READ_AHEAD_WORKERS 2
+static struct workqueue *read_ahead_wq;
+
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
   list_init (&open_inodes);
   cache_init();
+  page_cache_init ();
+  read_ahead_wq = workqueue_create ("read_ahead", READ_AHEAD_WORKERS,
+                                    PRI_DEFAULT);
+}
+
+/* Waits for read-ahead in progress to finish. */
+void
+inode_done (void)
+{
+  if (read_ahead_wq != NULL)
+    workqueue_flush (read_ahead_wq);
 }
 
 bool
 inode_create(block_sector_t sector, off_t length)
 {
-    return inode_create_real (sector, length, false); 
+    return inode_create_real (sector, length, false, 0); 
+}
+
+// Create a directory inode whose ".." resolves to PARENT
+bool
+inode_create_dir(block_sector_t sector, off_t length, block_sector_t parent)
+{
+    return inode_create_real (sector, length, true, parent);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -99,8 +135,9 @@ inode_create(block_sector_t sector, off_t length)
    device.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
-bool
-inode_create_real (block_sector_t sector, off_t length, bool isdir)
+static bool
+inode_create_real (block_sector_t sector, off_t length, bool isdir,
+                   block_sector_t parent)
 {
   struct inode_disk *disk_inode = NULL;
   struct inode inode;
@@ -120,6 +157,7 @@ inode_create_real (block_sector_t sector, off_t length, bool isdir)
   inode.sector = sector;
   inode.data = *disk_inode;
   inode.data.isdir = isdir;
+  inode.data.parent = parent;
   success = inode_extend(&inode, length);
   free(disk_inode);
   return true;
@@ -177,6 +215,7 @@ inode_open (block_sector_t sector)
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  rwlock_init (&inode->fill_lock, RWLOCK_PREFER_WRITERS);
   // if ((ce = cache_get(inode->sector)) != NULL) {
   //   memcpy(&inode->data, ce->data, BLOCK_SECTOR_SIZE);
   // }
@@ -184,7 +223,7 @@ inode_open (block_sector_t sector)
   //   block_read (fs_device, inode->sector, &inode->data);
   //   cache_set(inode->sector, (uint8_t *) &inode->data);
   // }
-  block_read(fs_device, inode->sector, &inode->data);
+  journal_read(inode->sector, &inode->data);
   return inode;
 }
 
@@ -220,7 +259,7 @@ inode_free(struct inode *inode)
     memset(level1_buffer, 0, sizeof(block_sector_t) * BLOCK_SECTOR_SIZE);
     memset(level1_buffer, 0, sizeof(block_sector_t) * BLOCK_SECTOR_SIZE);
     if (num_sectors > 12) {
-        block_read(fs_device, disk_inode->blocks[12], level1_buffer);
+        journal_read(disk_inode->blocks[12], level1_buffer);
     }
     for (i = 0 ; i < num_sectors ; i ++) {
         if (i < 12) {
@@ -233,7 +272,7 @@ inode_free(struct inode *inode)
             level2_ofs = (i - 12 - 64) % 128;
             level1_ofs = (i - 12 - 64) / 128 + 64;
             if (level2_ofs == 0)
-                block_read(fs_device, level1_buffer[level1_ofs], level2_buffer);
+                journal_read(level1_buffer[level1_ofs], level2_buffer);
             free_map_release(level2_buffer[level2_ofs], 1);
             if (level2_ofs == 127)
                 free_map_release(level1_buffer[level1_ofs], 1);
@@ -264,7 +303,10 @@ inode_close (struct inode *inode)
       /* Deallocate blocks if removed. */
       if (inode->removed)
         {
+          page_cache_drop (inode->sector);
+          journal_begin ();
           inode_free(inode);
+          journal_end ();
           // free_map_release (inode->sector, 1);
           // free_map_release (inode->data.start,
           //                  bytes_to_sectors (inode->data.length));
@@ -283,24 +325,117 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
-void inode_read_ahead(void *aux) {
-    block_sector_t index = *(int *)aux;
-    struct cache_entry *ce = cache_get(index + 1);
-    uint8_t buffer[BLOCK_SECTOR_SIZE];
-    
-    if (ce == NULL) {
-        block_read(fs_device, index + 1, buffer);
-        cache_set(index + 1, buffer);
+/* Stores in SECTORS the disk sector of each part of page INDEX
+   of INODE, or PAGE_NO_SECTOR for parts past end of file.  Each
+   indirect block is read only once, rather than once per sector
+   as byte_to_sector() would. */
+static void
+page_sectors (const struct inode *inode, size_t index,
+              block_sector_t sectors[PAGE_SECTORS])
+{
+  block_sector_t *level1 = NULL;
+  block_sector_t *level2 = NULL;
+  off_t level2_ofs = -1;
+  size_t i;
+
+  for (i = 0; i < PAGE_SECTORS; i++)
+    sectors[i] = PAGE_NO_SECTOR;
+  for (i = 0; i < PAGE_SECTORS; i++)
+    {
+      /* Sector number within the file. */
+      off_t n = index * PAGE_SECTORS + i;
+
+      if (n * BLOCK_SECTOR_SIZE >= inode->data.length)
+        break;
+      if (n < 12)
+        {
+          sectors[i] = inode->data.blocks[n];
+          continue;
+        }
+      if (level1 == NULL)
+        {
+          level1 = malloc (BLOCK_SECTOR_SIZE);
+          if (level1 == NULL)
+            goto no_memory;
+          journal_read (inode->data.blocks[12], level1);
+        }
+      if (n < 12 + 64)
+        {
+          sectors[i] = level1[n - 12];
+          continue;
+        }
+      if (level2 == NULL)
+        {
+          level2 = malloc (BLOCK_SECTOR_SIZE);
+          if (level2 == NULL)
+            goto no_memory;
+        }
+      if ((n - 12 - 64) / 128 + 64 != level2_ofs)
+        {
+          level2_ofs = (n - 12 - 64) / 128 + 64;
+          journal_read (level1[level2_ofs], level2);
+        }
+      sectors[i] = level2[(n - 12 - 64) % 128];
     }
+  free (level1);
+  free (level2);
+  return;
+
+ no_memory:
+  /* Look up the rest one at a time instead. */
+  for (; i < PAGE_SECTORS; i++)
+    sectors[i] = byte_to_sector (inode, index * PGSIZE
+                                        + i * BLOCK_SECTOR_SIZE);
+  free (level1);
+  free (level2);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
+/* Fills in the disk sectors of the parts of PAGE, a page of
+   INODE, that hold the SIZE bytes starting at byte OFS within the
+   page and were past end of file when PAGE was cached. */
+static void
+map_sectors (const struct inode *inode, struct cached_page *page,
+             size_t ofs, size_t size)
+{
+  size_t i;
+
+  for (i = ofs / BLOCK_SECTOR_SIZE;
+       i <= (ofs + size - 1) / BLOCK_SECTOR_SIZE; i++)
+    if (page->sectors[i] == PAGE_NO_SECTOR)
+      page->sectors[i] = byte_to_sector (inode, page->index * PGSIZE
+                                                + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Returns page INDEX of INODE from the page cache, with a
+   reference that the caller must release, adding it if need be.
+   A new page is read from disk if FILL is true, otherwise zeroed.
+   Returns a null pointer if memory is short.  Pages are added
+   only while holding INODE's fill lock, so that none can appear,
+   with data older than the disk's, in the middle of an O_DIRECT
+   write. */
+static struct cached_page *
+get_page (struct inode *inode, size_t index, bool fill)
+{
+  struct cached_page *page = page_cache_lookup (inode->sector, index);
+
+  if (page == NULL)
+    {
+      block_sector_t sectors[PAGE_SECTORS];
+
+      rwlock_acquire_read (&inode->fill_lock);
+      page_sectors (inode, index, sectors);
+      page = page_cache_insert (inode->sector, index, sectors, fill);
+      rwlock_release (&inode->fill_lock);
+    }
+  return page;
+}
+
+/* Reads SIZE bytes from metadata INODE into BUFFER, starting at
+   OFFSET, a sector at a time through the sector cache, for
+   inode_read_at(). */
+static off_t
+read_sectors (struct inode *inode, uint8_t *buffer, off_t size, off_t offset)
 {
-  uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
   uint8_t *bounce = NULL;
 
@@ -329,7 +464,7 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
         if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
           {
             /* Read full sector directly into caller's buffer. */
-            block_read (fs_device, sector_idx, buffer + bytes_read);
+            journal_read (sector_idx, buffer + bytes_read);
             cache_set(sector_idx, buffer + bytes_read);
           }
         else
@@ -342,16 +477,12 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
                 if (bounce == NULL)
                   break;
               }
-            block_read (fs_device, sector_idx, bounce);
+            journal_read (sector_idx, bounce);
             cache_set(sector_idx, bounce);
             memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
           }
       }
 
-      // read ahead
-      thread_create("read_ahead", PRI_DEFAULT,
-              inode_read_ahead, &sector_idx);
-
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
@@ -362,6 +493,102 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
   return bytes_read;
 }
 
+/* A page for inode_read_ahead() to bring into the page cache. */
+struct read_ahead
+  {
+    struct work work;           /* Element in read_ahead_wq. */
+    struct inode *inode;        /* File, reopened for the reader. */
+    size_t index;               /* Page number within file. */
+  };
+
+// Reads page RA->index of RA->inode into the page cache, on a
+// read_ahead_wq worker so that the reader need not wait for it.
+void inode_read_ahead(struct work *w) {
+    struct read_ahead *ra = work_entry(w, struct read_ahead, work);
+    struct cached_page *page = get_page(ra->inode, ra->index, true);
+
+    if (page != NULL)
+        page_cache_release(page);
+    inode_close(ra->inode);
+    free(ra);
+}
+
+/* Starts reading page INDEX of INODE into the page cache in the
+   background, unless it is cached already or past end of file. */
+static void
+start_read_ahead (struct inode *inode, size_t index)
+{
+  struct cached_page *page;
+  struct read_ahead *ra;
+
+  if ((off_t) (index * PGSIZE) >= inode_length (inode))
+    return;
+  page = page_cache_lookup (inode->sector, index);
+  if (page != NULL)
+    {
+      page_cache_release (page);
+      return;
+    }
+
+  if (read_ahead_wq == NULL)
+    return;
+  ra = malloc (sizeof *ra);
+  if (ra == NULL)
+    return;
+  ra->inode = inode_reopen (inode);
+  ra->index = index;
+  work_init (&ra->work, inode_read_ahead, PRI_DEFAULT);
+  workqueue_queue (read_ahead_wq, &ra->work);
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached. */
+off_t
+inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  if (inode_is_metadata (inode))
+    return read_sectors (inode, buffer, size, offset);
+
+  while (size > 0)
+    {
+      /* Page to read, starting byte offset within page. */
+      size_t index = offset / PGSIZE;
+      int page_ofs = offset % PGSIZE;
+      struct cached_page *page;
+
+      /* Bytes left in inode, bytes left in page, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int page_left = PGSIZE - page_ofs;
+      int min_left = inode_left < page_left ? inode_left : page_left;
+
+      /* Number of bytes to actually copy out of this page. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      page = get_page (inode, index, true);
+      if (page == NULL)
+        break;
+      memcpy (buffer + bytes_read, page->kpage + page_ofs, chunk_size);
+      page_cache_release (page);
+
+      /* Reading to the end of a page suggests sequential access. */
+      if (page_ofs + chunk_size == PGSIZE)
+        start_read_ahead (inode, index + 1);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_read += chunk_size;
+    }
+
+  return bytes_read;
+}
+
 // extend inode's size to (size)
 bool inode_extend(struct inode *inode, off_t size) {
     off_t current_sectors = bytes_to_sectors(inode_length(inode));
@@ -387,7 +614,7 @@ bool inode_extend(struct inode *inode, off_t size) {
     memset(level2_buffer, 0, BLOCK_SECTOR_SIZE);
     // load level 1 block first
     if (current_sectors > 12)
-        block_read(fs_device, inode->data.blocks[12], level1_buffer);
+        journal_read(inode->data.blocks[12], level1_buffer);
     // if level 1 block isn't allocate but we need it
     // then create it
     else if (to_sectors > 12) {
@@ -397,13 +624,13 @@ bool inode_extend(struct inode *inode, off_t size) {
             free(zeros);
             return false;
         }
-        block_write(fs_device, level1_idx, zeros);
+        journal_write(level1_idx, zeros);
         inode->data.blocks[12] = level1_idx;
     }
     // check if we need to load current max level2 block
     if (current_sectors > (12 + 64)) {
         off_t ofs = (current_sectors - 1 - 12 - 64) / 128 + 64;
-        block_read(fs_device, level1_buffer[ofs], level2_buffer);
+        journal_read(level1_buffer[ofs], level2_buffer);
     }
     // allocate blocks
     for (i = current_sectors ; i < to_sectors ; i++) {
@@ -433,7 +660,7 @@ bool inode_extend(struct inode *inode, off_t size) {
             }
             level2_buffer[level2_ofs] = sector_idx;
             if (level2_ofs == 127) {
-                block_write(fs_device, level1_buffer[level1_ofs], level2_buffer);
+                journal_write(level1_buffer[level1_ofs], level2_buffer);
             }
         }
         else {
@@ -445,20 +672,91 @@ bool inode_extend(struct inode *inode, off_t size) {
     }
     // save level 2 buffer to disk
     if (to_sectors > 12 + 64)
-        block_write(fs_device, level1_buffer[level1_ofs], level2_buffer);
+        journal_write(level1_buffer[level1_ofs], level2_buffer);
     // save level 1 buffer to disk
     if (to_sectors > 12)
-        block_write(fs_device, disk_inode->blocks[12], level1_buffer);
+        journal_write(disk_inode->blocks[12], level1_buffer);
     // extend success, save inode to disk
     inode->data.length = size;
     disk_inode->magic = INODE_MAGIC;
-    block_write(fs_device, inode->sector, disk_inode);
+    journal_write(inode->sector, disk_inode);
     free(level1_buffer);
     free(level2_buffer);
     free(zeros);
     return true;
 }
 
+/* Extends INODE to SIZE bytes, growing it by at most
+   JOURNAL_GROW_SECTORS sectors per journal operation so that no
+   operation writes more than journal_begin() reserved for it.
+   Each step leaves a consistent, longer file.  Returns false if
+   the disk fills up first. */
+bool
+inode_grow (struct inode *inode, off_t size)
+{
+  while (inode_length (inode) < size)
+    {
+      off_t step = ((off_t) bytes_to_sectors (inode_length (inode))
+                    + JOURNAL_GROW_SECTORS) * BLOCK_SECTOR_SIZE;
+      bool extended;
+
+      journal_begin ();
+      extended = inode_extend (inode, size < step ? size : step);
+      journal_end ();
+      if (!extended)
+        return false;
+    }
+  return true;
+}
+
+/* Writes SIZE bytes from BUFFER into metadata INODE, starting
+   at OFFSET, which the caller has made sure is within INODE, a
+   sector at a time through the journal, for inode_write_at(). */
+static off_t
+write_sectors (struct inode *inode, const uint8_t *buffer, off_t size,
+               off_t offset)
+{
+  off_t bytes_written = 0;
+  uint8_t *bounce = malloc (BLOCK_SECTOR_SIZE);
+
+  if (bounce == NULL)
+    return 0;
+  while (size > 0)
+    {
+      /* Sector to write, starting byte offset within sector. */
+      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      struct cache_entry *ce = cache_get(sector_idx);
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      off_t inode_left = inode_length (inode) - offset;
+      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+      /* Number of bytes to actually write into this sector. */
+      int chunk_size = size < min_left ? size : min_left;
+      if (chunk_size <= 0)
+        break;
+
+      /* Directories and the free map go through the journal,
+         which keeps any cached copy up to date. */
+      if (ce != NULL)
+        memcpy (bounce, ce->data, BLOCK_SECTOR_SIZE);
+      else
+        journal_read (sector_idx, bounce);
+      memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
+      journal_write (sector_idx, bounce);
+
+      /* Advance. */
+      size -= chunk_size;
+      offset += chunk_size;
+      bytes_written += chunk_size;
+    }
+  free (bounce);
+
+  return bytes_written;
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
    less than SIZE if end of file is reached or an error occurs.
@@ -470,7 +768,6 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
 
   if (inode->deny_write_cnt)
     return 0;
@@ -478,70 +775,274 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   // If there is no enough space in inode, allocate first
   // if extend size fail, return 0
   if (offset + size > inode_length(inode)
-          && !inode_extend(inode, offset + size))
-        return 0;
+      && !inode_grow (inode, offset + size))
+    return 0;
+
+  if (inode_is_metadata (inode))
+    return write_sectors (inode, buffer, size, offset);
 
   while (size > 0)
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      struct cache_entry *ce = cache_get(sector_idx);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      /* Page to write, starting byte offset within page. */
+      size_t index = offset / PGSIZE;
+      int page_ofs = offset % PGSIZE;
+      struct cached_page *page;
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
+      /* Bytes left in inode, bytes left in page, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+      int page_left = PGSIZE - page_ofs;
+      int min_left = inode_left < page_left ? inode_left : page_left;
 
-      /* Number of bytes to actually write into this sector. */
+      /* Number of bytes to actually write into this page. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
         break;
 
-      if (ce != NULL) {
-          cache_update(ce, sector_ofs, buffer + bytes_written,
-                  chunk_size);
-      }
-      else {
-        if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-          {
-            /* Write full sector directly to disk. */
-            block_write (fs_device, sector_idx, buffer + bytes_written);
-            cache_set(sector_idx, buffer + bytes_written);
-          }
-        else
-          {
-            /* We need a bounce buffer. */
-            if (bounce == NULL)
-              {
-                bounce = malloc (BLOCK_SECTOR_SIZE);
-                if (bounce == NULL)
-                  break;
-              }
-
-            /* If the sector contains data before or after the chunk
-               we're writing, then we need to read in the sector
-               first.  Otherwise we start with a sector of all zeros. */
-            if (sector_ofs > 0 || chunk_size < sector_left)
-              block_read (fs_device, sector_idx, bounce);
-            else
-              memset (bounce, 0, BLOCK_SECTOR_SIZE);
-            memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-            block_write (fs_device, sector_idx, bounce);
-            cache_set(sector_idx, bounce);
-          }
-      }
+      /* A page that will be overwritten entirely need not be
+         read first. */
+      page = get_page (inode, index, chunk_size < PGSIZE);
+      if (page == NULL)
+        break;
+      map_sectors (inode, page, page_ofs, chunk_size);
+      memcpy (page->kpage + page_ofs, buffer + bytes_written, chunk_size);
+      page_cache_mark_dirty (page);
+      page_cache_release (page);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
 
+/* Returns the number of whole sectors, no more than SIZE bytes
+   and not past the end of its page, that follow the one at
+   OFFSET in INODE and, like it, lie at consecutive sectors on
+   disk.  The sector at OFFSET is SECTOR. */
+static size_t
+direct_run (const struct inode *inode, block_sector_t sector,
+            off_t offset, off_t size)
+{
+  size_t cnt = 1;
+
+  while ((offset + cnt * BLOCK_SECTOR_SIZE) % PGSIZE != 0
+         && size >= (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE
+         && byte_to_sector (inode, offset + cnt * BLOCK_SECTOR_SIZE)
+            == sector + cnt)
+    cnt++;
+  return cnt;
+}
+
+/* Copies SIZE bytes, all within one sector, between BUFFER and
+   INODE at OFFSET for an O_DIRECT transfer, into INODE if WRITE
+   is true.  The cached page is used if there is one; otherwise
+   the sector is read into BOUNCE and, for a write, written back,
+   so that the page cache is left as it is. */
+static void
+direct_partial (struct inode *inode, uint8_t *buffer, off_t size,
+                off_t offset, bool write, uint8_t *bounce)
+{
+  struct cached_page *page = page_cache_lookup (inode->sector,
+                                                offset / PGSIZE);
+
+  if (page != NULL)
+    {
+      if (write)
+        {
+          map_sectors (inode, page, offset % PGSIZE, size);
+          memcpy (page->kpage + offset % PGSIZE, buffer, size);
+          page_cache_mark_dirty (page);
+        }
+      else
+        memcpy (buffer, page->kpage + offset % PGSIZE, size);
+      page_cache_release (page);
+    }
+  else
+    {
+      block_sector_t sector_idx = byte_to_sector (inode, offset);
+
+      block_read (fs_device, sector_idx, bounce);
+      if (write)
+        {
+          memcpy (bounce + offset % BLOCK_SECTOR_SIZE, buffer, size);
+          block_write (fs_device, sector_idx, bounce);
+        }
+      else
+        memcpy (buffer, bounce + offset % BLOCK_SECTOR_SIZE, size);
+    }
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at OFFSET,
+   like inode_read_at(), but leaves the page cache as it is:
+   sectors of pages that are not cached are read from disk, up to
+   a page at a time, through a bounce page, and cached pages,
+   which may be newer than the disk, are copied from the
+   cache. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer_, off_t size,
+                   off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+  uint8_t *bounce;
+
+  if (offset >= inode_length (inode))
+    return 0;
+  if (size > inode_length (inode) - offset)
+    size = inode_length (inode) - offset;
+  bounce = palloc_get_page (0);
+  if (inode_is_metadata (inode) || bounce == NULL)
+    {
+      palloc_free_page (bounce);
+      return inode_read_at (inode, buffer, size, offset);
+    }
+
+  /* Leading partial sector. */
+  if (offset % BLOCK_SECTOR_SIZE != 0)
+    {
+      off_t chunk = BLOCK_SECTOR_SIZE - offset % BLOCK_SECTOR_SIZE;
+      if (chunk > size)
+        chunk = size;
+      direct_partial (inode, buffer, chunk, offset, false, bounce);
+      size -= chunk;
+      offset += chunk;
+      bytes_read = chunk;
+    }
+
+  while (size >= BLOCK_SECTOR_SIZE)
+    {
+      struct cached_page *page = page_cache_lookup (inode->sector,
+                                                    offset / PGSIZE);
+      off_t chunk;
+
+      if (page != NULL)
+        {
+          /* The rest of this page comes from the cache. */
+          chunk = PGSIZE - offset % PGSIZE;
+          if (chunk > size)
+            chunk = size;
+          memcpy (buffer + bytes_read, page->kpage + offset % PGSIZE, chunk);
+          page_cache_release (page);
+        }
+      else
+        {
+          block_sector_t sector_idx = byte_to_sector (inode, offset);
+          size_t cnt = direct_run (inode, sector_idx, offset, size);
+
+          chunk = cnt * BLOCK_SECTOR_SIZE;
+          block_read_multi (fs_device, sector_idx, cnt, bounce);
+          memcpy (buffer + bytes_read, bounce, chunk);
+        }
+      size -= chunk;
+      offset += chunk;
+      bytes_read += chunk;
+    }
+
+  /* Trailing partial sector. */
+  if (size > 0)
+    {
+      direct_partial (inode, buffer + bytes_read, size, offset, false,
+                      bounce);
+      bytes_read += size;
+    }
+  palloc_free_page (bounce);
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET,
+   like inode_write_at(), but leaves the page cache as it is:
+   sectors of pages that are not cached are written to disk, up
+   to a page at a time, through a bounce page.  Cached pages are
+   updated in the cache instead, so that a dirty cached page
+   never overwrites newer data later.  INODE's fill lock is held
+   throughout, so that no page can be cached, with the data this
+   write is replacing, between checking the cache and writing the
+   disk. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer_, off_t size,
+                    off_t offset)
+{
+  uint8_t *buffer = (uint8_t *) buffer_;
+  off_t bytes_written = 0;
+  uint8_t *bounce;
+
+  if (inode->deny_write_cnt)
+    return 0;
+  bounce = palloc_get_page (0);
+  if (inode_is_metadata (inode) || bounce == NULL)
+    {
+      palloc_free_page (bounce);
+      return inode_write_at (inode, buffer, size, offset);
+    }
+
+  if (offset + size > inode_length (inode)
+      && !inode_grow (inode, offset + size))
+    {
+      palloc_free_page (bounce);
+      return 0;
+    }
+
+  rwlock_acquire_write (&inode->fill_lock);
+
+  /* Leading partial sector. */
+  if (offset % BLOCK_SECTOR_SIZE != 0)
+    {
+      off_t chunk = BLOCK_SECTOR_SIZE - offset % BLOCK_SECTOR_SIZE;
+      if (chunk > size)
+        chunk = size;
+      direct_partial (inode, buffer, chunk, offset, true, bounce);
+      size -= chunk;
+      offset += chunk;
+      bytes_written = chunk;
+    }
+
+  while (size >= BLOCK_SECTOR_SIZE)
+    {
+      struct cached_page *page = page_cache_lookup (inode->sector,
+                                                    offset / PGSIZE);
+      off_t chunk;
+
+      if (page != NULL)
+        {
+          /* The rest of this page goes into the cache. */
+          chunk = PGSIZE - offset % PGSIZE;
+          if (chunk > size)
+            chunk = size;
+          map_sectors (inode, page, offset % PGSIZE, chunk);
+          memcpy (page->kpage + offset % PGSIZE, buffer + bytes_written,
+                  chunk);
+          page_cache_mark_dirty (page);
+          page_cache_release (page);
+        }
+      else
+        {
+          block_sector_t sector_idx = byte_to_sector (inode, offset);
+          size_t cnt = direct_run (inode, sector_idx, offset, size);
+
+          chunk = cnt * BLOCK_SECTOR_SIZE;
+          memcpy (bounce, buffer + bytes_written, chunk);
+          block_write_multi (fs_device, sector_idx, cnt, bounce);
+        }
+      size -= chunk;
+      offset += chunk;
+      bytes_written += chunk;
+    }
+
+  /* Trailing partial sector. */
+  if (size > 0)
+    {
+      direct_partial (inode, buffer + bytes_written, size, offset, true,
+                      bounce);
+      bytes_written += size;
+    }
+
+  rwlock_release (&inode->fill_lock);
+  palloc_free_page (bounce);
+  return bytes_written;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -5,6 +5,7 @@
 #include <list.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
+#include "threads/synch.h"
 
 struct bitmap;
 /* In-memory inode. */
@@ -17,7 +18,8 @@ struct inode_disk
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
     bool isdir;
-    uint32_t unused[112];               /* Not used. */
+    block_sector_t parent;              /* Parent directory's sector. */
+    uint32_t unused[111];               /* Not used. */
   };
 
 
@@ -29,12 +31,17 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock fill_lock;            /* Read to add pages to the page
+                                           cache, write for O_DIRECT
+                                           writes. */
     struct inode_disk data;             /* Inode content. */
   };
 
 
 void inode_init (void);
+void inode_done (void);
 bool inode_create (block_sector_t, off_t);
+bool inode_create_dir (block_sector_t, off_t, block_sector_t parent);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
@@ -42,6 +49,10 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_grow (struct inode *, off_t size);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+                          off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
@@ -0,0 +1,531 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Inode sectors, indirect blocks, directory contents, and the
+   free map are never written in place directly.  journal_write()
+   instead stores the new contents of the sector in memory as
+   part of the running transaction, and every operation that
+   modifies metadata (creating, extending, or removing a file,
+   making a directory, ...) is bracketed by journal_begin() and
+   journal_end().
+
+   Each operation reserves room in the log for everything it may
+   write when it begins, waiting if the operations already in
+   progress leave too little, so a transaction never has to be
+   committed while an operation is half done.
+
+   Group commit: the running transaction is committed only once
+   no operation is in progress and either JOURNAL_GROUP
+   operations have finished or it has grown large, so many
+   operations share one sequential write of the log.  Committing
+   appends each modified sector to the log area and then
+   rewrites the header sector, whose single-sector write is the
+   commit point.  A sector changed many times before a commit is
+   logged only once.
+
+   Committed sectors are written to their home locations by the
+   checkpointer only when the log area fills up or at shutdown.
+   Until then, reads are served from memory by journal_read().
+   At boot, journal_init() replays any records left in the log by
+   a crash.
+
+   Journal blocks and their sector buffers come from pools
+   allocated once by journal_init(), large enough for a full
+   running transaction on top of a full log, so journal_write()
+   never runs out of memory in the middle of an operation.
+
+   Freeing sectors clears their bits in the free map as part of
+   the transaction, but they cannot be reused until that
+   transaction has been checkpointed, or a crash could replay old
+   metadata over new file data, so journal_release() holds them
+   back until then. */
+
+/* Identifies a journal header. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Operations committed together, at most. */
+#define JOURNAL_GROUP 8
+
+/* Journal blocks, and sector buffers, that can be in use at once:
+   one per record of the running transaction plus one per record
+   in the log. */
+#define JOURNAL_POOL (2 * JOURNAL_RECORDS)
+
+/* On-disk journal header.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_header
+  {
+    uint32_t magic;                     /* Magic number. */
+    uint32_t count;                     /* Committed records. */
+    block_sector_t sectors[JOURNAL_RECORDS]; /* Home of each record. */
+    uint32_t unused[126 - JOURNAL_RECORDS];  /* Not used. */
+  };
+
+/* A metadata sector with contents not yet at its home location. */
+struct journal_block
+  {
+    block_sector_t sector;              /* Home location. */
+    uint8_t *running;                   /* Uncommitted contents or null. */
+    uint8_t *committed;                 /* Logged contents or null. */
+    struct list_elem elem;              /* Element in `blocks'. */
+    struct hash_elem hash_elem;         /* Element in `block_index'. */
+  };
+
+/* A run of sectors waiting to be given back to the free map. */
+struct journal_free
+  {
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    struct list_elem elem;              /* Element in a free list. */
+  };
+
+static struct lock journal_lock;        /* Protects everything below. */
+static struct list blocks;              /* All `struct journal_block's. */
+static struct hash block_index;         /* `blocks', by sector. */
+static struct journal_header header;    /* Copy of the log header. */
+static size_t running_cnt;              /* Blocks with running contents. */
+static int active_ops;                  /* Operations in progress. */
+static int finished_ops;                /* Operations since last commit. */
+static struct condition log_space;      /* Signaled as operations end. */
+static size_t op_records;               /* Records reserved per operation. */
+
+static struct journal_block *free_blocks[JOURNAL_POOL]; /* Unused blocks. */
+static size_t free_block_cnt;           /* Number of unused blocks. */
+static uint8_t *free_buffers[JOURNAL_POOL]; /* Unused sector buffers. */
+static size_t free_buffer_cnt;          /* Number of unused buffers. */
+
+static struct list running_frees;       /* Freed by running transaction. */
+static struct list committed_frees;     /* Freed by committed transactions. */
+static struct list ready_frees;         /* Checkpointed, safe to reuse. */
+
+static hash_hash_func block_hash;
+static hash_less_func block_less;
+static struct journal_block *find_block (block_sector_t);
+static struct journal_block *alloc_block (void);
+static void free_block (struct journal_block *);
+static uint8_t *alloc_buffer (void);
+static void free_buffer (uint8_t *);
+static void commit (void);
+static void checkpoint (void);
+static void write_header (void);
+static void release_ready_frees (void);
+
+/* Initializes the journal.  If FORMAT is true, writes an empty
+   log; otherwise replays whatever a crash left in the log. */
+void
+journal_init (bool format)
+{
+  struct journal_block *pool_blocks;
+  uint8_t *pool_buffers;
+  size_t i;
+
+  ASSERT (sizeof header == BLOCK_SECTOR_SIZE);
+
+  lock_init (&journal_lock);
+  cond_init (&log_space);
+  list_init (&blocks);
+  hash_init (&block_index, block_hash, block_less, NULL);
+  list_init (&running_frees);
+  list_init (&committed_frees);
+  list_init (&ready_frees);
+  running_cnt = 0;
+  active_ops = finished_ops = 0;
+
+  pool_blocks = malloc (JOURNAL_POOL * sizeof *pool_blocks);
+  pool_buffers = malloc (JOURNAL_POOL * BLOCK_SECTOR_SIZE);
+  if (pool_blocks == NULL || pool_buffers == NULL)
+    PANIC ("out of memory allocating the journal");
+  for (i = 0; i < JOURNAL_POOL; i++)
+    {
+      free_blocks[i] = &pool_blocks[i];
+      free_buffers[i] = pool_buffers + i * BLOCK_SECTOR_SIZE;
+    }
+  free_block_cnt = free_buffer_cnt = JOURNAL_POOL;
+
+  /* Every operation may rewrite the whole free map, which is
+     written out in one piece. */
+  op_records = (JOURNAL_OP_RECORDS
+                + DIV_ROUND_UP (DIV_ROUND_UP (block_size (fs_device), 8),
+                                BLOCK_SECTOR_SIZE));
+  if (op_records > JOURNAL_RECORDS)
+    PANIC ("file system device is too large for the journal");
+
+  if (!format)
+    {
+      block_read (fs_device, JOURNAL_SECTOR, &header);
+      if (header.magic == JOURNAL_MAGIC && header.count > 0
+          && header.count <= JOURNAL_RECORDS)
+        {
+          uint8_t buffer[BLOCK_SECTOR_SIZE];
+
+          printf ("Replaying %u journal records...\n", header.count);
+          for (i = 0; i < header.count; i++)
+            {
+              block_read (fs_device, JOURNAL_SECTOR + 1 + i, buffer);
+              block_write (fs_device, header.sectors[i], buffer);
+            }
+        }
+    }
+
+  memset (&header, 0, sizeof header);
+  header.magic = JOURNAL_MAGIC;
+  write_header ();
+}
+
+/* Commits and checkpoints everything, leaving an empty log. */
+void
+journal_done (void)
+{
+  journal_flush ();
+}
+
+/* Starts an operation that modifies metadata, first waiting
+   until the log has room for everything it may write.  An
+   operation may write at most JOURNAL_OP_RECORDS sectors besides
+   the free map.  Operations may nest; a nested operation is part
+   of the outermost one and shares its reservation. */
+void
+journal_begin (void)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (running_cnt + (active_ops + 1) * op_records > JOURNAL_RECORDS)
+    {
+      if (active_ops == 0)
+        commit ();
+      else
+        cond_wait (&log_space, &journal_lock);
+    }
+  active_ops++;
+  lock_release (&journal_lock);
+}
+
+/* Ends an operation started by journal_begin(), committing the
+   running transaction if it has gathered enough operations. */
+void
+journal_end (void)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (cur->journal_depth > 0);
+  if (--cur->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (active_ops > 0);
+  active_ops--;
+  finished_ops++;
+  if (active_ops == 0
+      && (finished_ops >= JOURNAL_GROUP
+          || running_cnt >= JOURNAL_RECORDS / 2))
+    commit ();
+  cond_broadcast (&log_space, &journal_lock);
+  lock_release (&journal_lock);
+  release_ready_frees ();
+}
+
+/* Writes every committed transaction to its home locations so
+   that the sectors they freed can be reused.  The running
+   transaction is not committed, so this may be called in the
+   middle of an operation. */
+void
+journal_checkpoint (void)
+{
+  lock_acquire (&journal_lock);
+  checkpoint ();
+  lock_release (&journal_lock);
+  release_ready_frees ();
+}
+
+/* Commits the running transaction and checkpoints every
+   committed transaction, leaving an empty log, so that all freed
+   sectors become available again.  Used when formatting and at
+   shutdown, when no operation is in progress. */
+void
+journal_flush (void)
+{
+  lock_acquire (&journal_lock);
+  commit ();
+  checkpoint ();
+  lock_release (&journal_lock);
+  release_ready_frees ();
+}
+
+/* Reads the newest contents of metadata SECTOR into BUFFER. */
+void
+journal_read (block_sector_t sector, void *buffer)
+{
+  struct journal_block *b;
+
+  lock_acquire (&journal_lock);
+  b = find_block (sector);
+  if (b != NULL)
+    {
+      memcpy (buffer, b->running != NULL ? b->running : b->committed,
+              BLOCK_SECTOR_SIZE);
+      lock_release (&journal_lock);
+      return;
+    }
+  lock_release (&journal_lock);
+  block_read (fs_device, sector, buffer);
+}
+
+/* Makes BUFFER the new contents of metadata SECTOR as part of the
+   running transaction. */
+void
+journal_write (block_sector_t sector, const void *buffer)
+{
+  struct journal_block *b;
+  struct cache_entry *ce;
+
+  lock_acquire (&journal_lock);
+
+  /* Keep any cached copy current, but clean, so that the cache
+     never writes the sector home ahead of the log. */
+  ce = cache_get (sector);
+  if (ce != NULL)
+    {
+      memcpy (ce->data, buffer, BLOCK_SECTOR_SIZE);
+      ce->dirty = 0;
+    }
+
+  b = find_block (sector);
+  if (b == NULL)
+    {
+      b = alloc_block ();
+      b->sector = sector;
+      b->running = b->committed = NULL;
+      list_push_back (&blocks, &b->elem);
+      hash_insert (&block_index, &b->hash_elem);
+    }
+  if (b->running == NULL)
+    {
+      /* Operations reserve their records in journal_begin(), so
+         only writes made outside any operation, as when
+         formatting, can find the log full. */
+      if (running_cnt >= JOURNAL_RECORDS)
+        {
+          ASSERT (active_ops == 0);
+          commit ();
+        }
+      b->running = alloc_buffer ();
+      running_cnt++;
+    }
+  memcpy (b->running, buffer, BLOCK_SECTOR_SIZE);
+  lock_release (&journal_lock);
+}
+
+/* Returns CNT sectors starting at SECTOR to the free map once the
+   running transaction, which freed them, has been checkpointed. */
+void
+journal_release (block_sector_t sector, size_t cnt)
+{
+  struct journal_free *f = malloc (sizeof *f);
+
+  /* Out of memory: the sectors are free on disk, so they only
+     stay unusable until the free map is next read at boot. */
+  if (f == NULL)
+    return;
+  f->sector = sector;
+  f->cnt = cnt;
+  lock_acquire (&journal_lock);
+  list_push_back (&running_frees, &f->elem);
+  lock_release (&journal_lock);
+}
+
+/* Returns the journal block for SECTOR, or a null pointer if
+   SECTOR has no contents newer than its home location. */
+static struct journal_block *
+find_block (block_sector_t sector)
+{
+  struct journal_block key;
+  struct hash_elem *e;
+
+  if (hash_empty (&block_index))
+    return NULL;
+  key.sector = sector;
+  e = hash_find (&block_index, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct journal_block, hash_elem) : NULL;
+}
+
+/* Returns a hash value for journal block B_. */
+static unsigned
+block_hash (const struct hash_elem *b_, void *aux UNUSED)
+{
+  const struct journal_block *b = hash_entry (b_, struct journal_block,
+                                              hash_elem);
+  return hash_int (b->sector);
+}
+
+/* Returns true if journal block A_ precedes journal block B_. */
+static bool
+block_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct journal_block *a = hash_entry (a_, struct journal_block,
+                                              hash_elem);
+  const struct journal_block *b = hash_entry (b_, struct journal_block,
+                                              hash_elem);
+  return a->sector < b->sector;
+}
+
+/* Takes a journal block from the pool.  A sector has a journal
+   block only while it has running or logged contents, so the pool
+   cannot run dry. */
+static struct journal_block *
+alloc_block (void)
+{
+  ASSERT (free_block_cnt > 0);
+  return free_blocks[--free_block_cnt];
+}
+
+/* Returns journal block B to the pool. */
+static void
+free_block (struct journal_block *b)
+{
+  ASSERT (free_block_cnt < JOURNAL_POOL);
+  free_blocks[free_block_cnt++] = b;
+}
+
+/* Takes a sector buffer from the pool.  Each buffer holds the
+   running or logged contents of one sector, so the pool cannot
+   run dry. */
+static uint8_t *
+alloc_buffer (void)
+{
+  ASSERT (free_buffer_cnt > 0);
+  return free_buffers[--free_buffer_cnt];
+}
+
+/* Returns sector buffer BUFFER to the pool. */
+static void
+free_buffer (uint8_t *buffer)
+{
+  ASSERT (free_buffer_cnt < JOURNAL_POOL);
+  free_buffers[free_buffer_cnt++] = buffer;
+}
+
+/* Appends the running transaction to the log and commits it,
+   checkpointing first if the log lacks room. */
+static void
+commit (void)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  finished_ops = 0;
+  if (running_cnt == 0)
+    {
+      while (!list_empty (&running_frees))
+        list_push_back (&committed_frees, list_pop_front (&running_frees));
+      return;
+    }
+  if (header.count + running_cnt > JOURNAL_RECORDS)
+    checkpoint ();
+
+  for (e = list_begin (&blocks); e != list_end (&blocks); e = list_next (e))
+    {
+      struct journal_block *b = list_entry (e, struct journal_block, elem);
+      if (b->running != NULL)
+        {
+          block_write (fs_device, JOURNAL_SECTOR + 1 + header.count,
+                       b->running);
+          header.sectors[header.count++] = b->sector;
+          if (b->committed != NULL)
+            free_buffer (b->committed);
+          b->committed = b->running;
+          b->running = NULL;
+        }
+    }
+  write_header ();
+  running_cnt = 0;
+
+  while (!list_empty (&running_frees))
+    list_push_back (&committed_frees, list_pop_front (&running_frees));
+}
+
+/* Writes every committed sector to its home location and empties
+   the log.  Sectors freed by committed transactions become ready
+   to be reused. */
+static void
+checkpoint (void)
+{
+  struct list_elem *e, *next;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  if (header.count == 0 && list_empty (&committed_frees))
+    return;
+
+  for (e = list_begin (&blocks); e != list_end (&blocks); e = next)
+    {
+      struct journal_block *b = list_entry (e, struct journal_block, elem);
+      next = list_next (e);
+      if (b->committed != NULL)
+        {
+          block_write (fs_device, b->sector, b->committed);
+          free_buffer (b->committed);
+          b->committed = NULL;
+        }
+      if (b->running == NULL)
+        {
+          list_remove (&b->elem);
+          hash_delete (&block_index, &b->hash_elem);
+          free_block (b);
+        }
+    }
+  header.count = 0;
+  write_header ();
+
+  while (!list_empty (&committed_frees))
+    list_push_back (&ready_frees, list_pop_front (&committed_frees));
+}
+
+/* Writes the in-memory log header to disk. */
+static void
+write_header (void)
+{
+  block_write (fs_device, JOURNAL_SECTOR, &header);
+}
+
+/* Gives checkpointed free sectors back to the free map, which
+   already has them free on disk and now lets them be allocated
+   again.  Called without holding journal_lock, which does not
+   protect the free map. */
+static void
+release_ready_frees (void)
+{
+  for (;;)
+    {
+      struct journal_free *f = NULL;
+
+      lock_acquire (&journal_lock);
+      if (!list_empty (&ready_frees))
+        f = list_entry (list_pop_front (&ready_frees),
+                        struct journal_free, elem);
+      lock_release (&journal_lock);
+      if (f == NULL)
+        break;
+
+      free_map_reclaim (f->sector, f->cnt);
+      free (f);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* The journal occupies JOURNAL_SECTORS sectors starting at
+   JOURNAL_SECTOR: one header sector followed by
+   JOURNAL_RECORDS record sectors. */
+#define JOURNAL_RECORDS 63
+#define JOURNAL_SECTORS (JOURNAL_RECORDS + 1)
+
+/* Log records one operation may use, not counting the free map,
+   and the most sectors a file may grow by in one operation
+   within that budget (its inode, its first-level indirect block,
+   and the second-level blocks that span them). */
+#define JOURNAL_OP_RECORDS 12
+#define JOURNAL_GROW_SECTORS 512
+
+void journal_init (bool format);
+void journal_done (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_checkpoint (void);
+void journal_flush (void);
+
+void journal_read (block_sector_t, void *);
+void journal_write (block_sector_t, const void *);
+void journal_release (block_sector_t, size_t);
+
+#endif /* filesys/journal.h */
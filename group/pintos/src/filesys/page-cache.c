@@ -0,0 +1,481 @@
+#include "filesys/page-cache.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/filesys.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+
+/* Cache of file data, a page at a time.
+
+   Regular file data is cached in whole pages, identified by the
+   file's inode sector and the page's number within the file, and
+   read from and written to disk as a page, in as few transfers
+   as the file's layout on disk allows: one, if its eight sectors
+   are consecutive.  File system metadata, which must go through
+   the journal, stays in the sector cache instead.
+
+   A page's data lives in a kernel page of its own, so the same
+   frame that serves read() and write() can also be mapped into a
+   user page table, for read-only and shared file mappings, with
+   pagedir_set_page().  The mapper holds a reference to the page,
+   which keeps it from being evicted, for as long as the mapping
+   lasts, and must call page_cache_mark_dirty() if the mapping
+   was written.
+
+   The cache has no fixed size.  It takes frames from the user
+   pool for as long as the pool has free ones, so that it grows
+   into memory that processes are not using, and gives them back
+   through its palloc shrinker when a process needs them.  Only
+   once the user pool is exhausted does the cache replace its
+   own pages, by the clock algorithm, falling back to a kernel
+   frame when every page it has is in use.  Pages are written
+   back when evicted and at shutdown.
+
+   Disk I/O is never done while holding the page cache lock.  A
+   page being read in is already in the table, marked as reading,
+   and lookups wait for the read to finish.  An evicted dirty page
+   is taken out of the table before it is written back, and until
+   the write is done, it stays on a list that keeps the same page
+   from being read in again too early. */
+
+static struct hash pages;               /* Pages by (inumber, index). */
+static struct list clock_list;          /* Pages in clock order. */
+static struct list_elem *hand;          /* Clock hand. */
+static size_t frame_cnt;                /* Frames owned by the cache. */
+static struct list writeback_list;      /* Evicted, being written back. */
+static struct condition io_done;        /* Signaled when I/O finishes. */
+static struct lock page_cache_lock;     /* Protects all of the above. */
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static struct cached_page *find (block_sector_t inumber, size_t index);
+static bool in_writeback (block_sector_t inumber, size_t index);
+static void wait_for_read (struct cached_page *);
+static struct cached_page *evict (bool user_only);
+static size_t page_cache_shrink (enum palloc_flags, size_t page_cnt);
+static struct palloc_shrinker shrinker;
+static void read_page (struct cached_page *);
+static void write_page (struct cached_page *);
+
+/* Initializes the page cache. */
+void
+page_cache_init (void)
+{
+  hash_init (&pages, page_hash, page_less, NULL);
+  list_init (&clock_list);
+  hand = NULL;
+  frame_cnt = 0;
+  list_init (&writeback_list);
+  cond_init (&io_done);
+  lock_init (&page_cache_lock);
+  shrinker.shrink = page_cache_shrink;
+  palloc_register_shrinker (&shrinker);
+}
+
+/* Returns the cached page INDEX of the file whose inode is at
+   sector INUMBER, with a new reference to it that the caller must
+   drop with page_cache_release(), or a null pointer if the page
+   is not cached.  If the page has been evicted but is still being
+   written back, waits for the write to finish first, so that a
+   null return means the disk is up to date. */
+struct cached_page *
+page_cache_lookup (block_sector_t inumber, size_t index)
+{
+  struct cached_page *p;
+
+  lock_acquire (&page_cache_lock);
+  for (;;)
+    {
+      p = find (inumber, index);
+      if (p != NULL)
+        {
+          p->ref_cnt++;
+          p->accessed = true;
+          wait_for_read (p);
+          break;
+        }
+      if (!in_writeback (inumber, index))
+        break;
+      cond_wait (&io_done, &page_cache_lock);
+    }
+  lock_release (&page_cache_lock);
+  return p;
+}
+
+/* Like page_cache_lookup(), but if the page is not cached, adds
+   it.  SECTORS gives the disk sector of each of the page's
+   sectors.  If FILL is true, the new page is read from disk,
+   otherwise zeroed because the caller will overwrite it.
+   Returns a null pointer if memory is short and every cached
+   page is in use. */
+struct cached_page *
+page_cache_insert (block_sector_t inumber, size_t index,
+                   const block_sector_t sectors[], bool fill)
+{
+  struct cached_page *p, *victim = NULL;
+  uint8_t *kpage;
+  bool user = true;
+
+  lock_acquire (&page_cache_lock);
+  for (;;)
+    {
+      p = find (inumber, index);
+      if (p != NULL)
+        {
+          p->ref_cnt++;
+          p->accessed = true;
+          wait_for_read (p);
+          lock_release (&page_cache_lock);
+          return p;
+        }
+
+      /* Reading the page while an evicted copy is still on its
+         way to disk could read stale data. */
+      if (!in_writeback (inumber, index))
+        break;
+      cond_wait (&io_done, &page_cache_lock);
+    }
+
+  p = malloc (sizeof *p);
+  if (p == NULL)
+    goto fail;
+  kpage = palloc_get_page (PAL_USER);
+  if (kpage == NULL)
+    {
+      victim = evict (false);
+      if (victim != NULL)
+        {
+          kpage = victim->kpage;
+          user = victim->user;
+        }
+      else
+        {
+          kpage = palloc_get_page (0);
+          user = false;
+          if (kpage == NULL)
+            goto fail;
+          frame_cnt++;
+        }
+    }
+  else
+    frame_cnt++;
+
+  p->inumber = inumber;
+  p->index = index;
+  memcpy (p->sectors, sectors, sizeof p->sectors);
+  p->kpage = kpage;
+  p->user = user;
+  p->dirty = false;
+  p->reading = true;
+  p->writing = false;
+  p->accessed = true;
+  p->ref_cnt = 1;
+  hash_insert (&pages, &p->hash_elem);
+  list_push_back (&clock_list, &p->list_elem);
+  lock_release (&page_cache_lock);
+
+  /* The victim's frame becomes P's once its data is on disk. */
+  if (victim != NULL && victim->dirty)
+    write_page (victim);
+  if (fill)
+    read_page (p);
+  else
+    memset (kpage, 0, PGSIZE);
+
+  lock_acquire (&page_cache_lock);
+  if (victim != NULL)
+    {
+      if (victim->dirty)
+        list_remove (&victim->list_elem);
+      free (victim);
+    }
+  p->reading = false;
+  cond_broadcast (&io_done, &page_cache_lock);
+  lock_release (&page_cache_lock);
+  return p;
+
+ fail:
+  free (p);
+  lock_release (&page_cache_lock);
+  return NULL;
+}
+
+/* Drops a reference to P. */
+void
+page_cache_release (struct cached_page *p)
+{
+  lock_acquire (&page_cache_lock);
+  ASSERT (p->ref_cnt > 0);
+  p->ref_cnt--;
+  lock_release (&page_cache_lock);
+}
+
+/* Marks P, to which the caller holds a reference, as modified,
+   so that it is written back before it leaves the cache. */
+void
+page_cache_mark_dirty (struct cached_page *p)
+{
+  lock_acquire (&page_cache_lock);
+  ASSERT (p->ref_cnt > 0);
+  p->dirty = true;
+  lock_release (&page_cache_lock);
+}
+
+/* Discards, without writing back, every cached page of the file
+   whose inode is at sector INUMBER, which is being deleted.
+   None of them may be referenced.  Waits for any write-back of
+   them to finish first, so that none lands on sectors the file
+   no longer owns. */
+void
+page_cache_drop (block_sector_t inumber)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&page_cache_lock);
+ retry:
+  for (e = list_begin (&writeback_list); e != list_end (&writeback_list);
+       e = list_next (e))
+    if (list_entry (e, struct cached_page, list_elem)->inumber == inumber)
+      {
+        cond_wait (&io_done, &page_cache_lock);
+        goto retry;
+      }
+  for (e = list_begin (&clock_list); e != list_end (&clock_list); e = next)
+    {
+      struct cached_page *p = list_entry (e, struct cached_page, list_elem);
+
+      next = list_next (e);
+      if (p->inumber != inumber)
+        continue;
+      if (p->writing)
+        {
+          cond_wait (&io_done, &page_cache_lock);
+          goto retry;
+        }
+      ASSERT (p->ref_cnt == 0);
+      if (hand == e)
+        hand = next;
+      list_remove (e);
+      hash_delete (&pages, &p->hash_elem);
+      palloc_free_page (p->kpage);
+      free (p);
+      frame_cnt--;
+    }
+  lock_release (&page_cache_lock);
+}
+
+/* Writes every modified page back to disk. */
+void
+page_cache_flush (void)
+{
+  struct list_elem *e;
+
+  lock_acquire (&page_cache_lock);
+  for (e = list_begin (&clock_list); e != list_end (&clock_list);
+       e = list_next (e))
+    {
+      struct cached_page *p = list_entry (e, struct cached_page, list_elem);
+      if (!p->dirty || p->reading || p->writing)
+        continue;
+
+      /* While P is being written, it is neither evicted nor
+         dropped, so it stays in the list.  A write to P meanwhile
+         marks it dirty again. */
+      p->writing = true;
+      p->dirty = false;
+      lock_release (&page_cache_lock);
+      write_page (p);
+      lock_acquire (&page_cache_lock);
+      p->writing = false;
+      cond_broadcast (&io_done, &page_cache_lock);
+    }
+  lock_release (&page_cache_lock);
+}
+
+/* Returns the cached page INDEX of file INUMBER, or a null
+   pointer.  The page cache lock must be held. */
+static struct cached_page *
+find (block_sector_t inumber, size_t index)
+{
+  struct cached_page key;
+  struct hash_elem *e;
+
+  key.inumber = inumber;
+  key.index = index;
+  e = hash_find (&pages, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct cached_page, hash_elem) : NULL;
+}
+
+/* Returns true if page INDEX of file INUMBER has been evicted but
+   not yet written back.  The page cache lock must be held. */
+static bool
+in_writeback (block_sector_t inumber, size_t index)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&writeback_list); e != list_end (&writeback_list);
+       e = list_next (e))
+    {
+      struct cached_page *p = list_entry (e, struct cached_page, list_elem);
+      if (p->inumber == inumber && p->index == index)
+        return true;
+    }
+  return false;
+}
+
+/* Waits until P, to which the caller holds a reference, has been
+   read in.  The page cache lock must be held. */
+static void
+wait_for_read (struct cached_page *p)
+{
+  while (p->reading)
+    cond_wait (&io_done, &page_cache_lock);
+}
+
+/* Picks an unreferenced page by the clock algorithm, only among
+   pages with frames from the user pool if USER_ONLY is true, and
+   removes it from the cache.  Returns the page, whose frame the
+   caller may reuse, or a null pointer if there is none to pick.
+   If the page is dirty, it is put on the write-back list, and
+   the caller must write it back, without holding the lock, then
+   take it off the list and signal io_done before reusing the
+   frame.  The page cache lock must be held. */
+static struct cached_page *
+evict (bool user_only)
+{
+  size_t i;
+
+  for (i = 0; i < 2 * frame_cnt; i++)
+    {
+      struct cached_page *p;
+
+      if (hand == NULL || hand == list_end (&clock_list))
+        hand = list_begin (&clock_list);
+      if (hand == list_end (&clock_list))
+        break;
+      p = list_entry (hand, struct cached_page, list_elem);
+      hand = list_next (hand);
+
+      if (p->ref_cnt > 0 || p->writing || (user_only && !p->user))
+        continue;
+      if (p->accessed)
+        {
+          p->accessed = false;
+          continue;
+        }
+      list_remove (&p->list_elem);
+      hash_delete (&pages, &p->hash_elem);
+      if (p->dirty)
+        list_push_back (&writeback_list, &p->list_elem);
+      return p;
+    }
+  return NULL;
+}
+
+/* Palloc shrinker: evicts up to PAGE_CNT pages with frames in
+   the user pool, if that is the pool FLAGS selects, and frees
+   their frames.  Returns the number of frames freed. */
+static size_t
+page_cache_shrink (enum palloc_flags flags, size_t page_cnt)
+{
+  size_t freed = 0;
+
+  /* A thread in the cache may be allocating a frame itself. */
+  if (!(flags & PAL_USER) || lock_held_by_current_thread (&page_cache_lock))
+    return 0;
+
+  lock_acquire (&page_cache_lock);
+  while (freed < page_cnt)
+    {
+      struct cached_page *p = evict (true);
+      if (p == NULL)
+        break;
+      if (p->dirty)
+        {
+          lock_release (&page_cache_lock);
+          write_page (p);
+          lock_acquire (&page_cache_lock);
+          list_remove (&p->list_elem);
+          cond_broadcast (&io_done, &page_cache_lock);
+        }
+      palloc_free_page (p->kpage);
+      free (p);
+      frame_cnt--;
+      freed++;
+    }
+  lock_release (&page_cache_lock);
+  return freed;
+}
+
+/* Returns the number of sectors, starting at part I of P, that
+   are consecutive on disk, or 1 if part I has no sector. */
+static size_t
+run_length (const struct cached_page *p, size_t i)
+{
+  size_t cnt = 1;
+
+  if (p->sectors[i] != PAGE_NO_SECTOR)
+    while (i + cnt < PAGE_SECTORS
+           && p->sectors[i + cnt] == p->sectors[i] + cnt)
+      cnt++;
+  return cnt;
+}
+
+/* Reads P's data from disk.  Parts past the end of the file read
+   as zeros. */
+static void
+read_page (struct cached_page *p)
+{
+  size_t i, cnt;
+
+  for (i = 0; i < PAGE_SECTORS; i += cnt)
+    {
+      uint8_t *data = p->kpage + i * BLOCK_SECTOR_SIZE;
+
+      cnt = run_length (p, i);
+      if (p->sectors[i] == PAGE_NO_SECTOR)
+        memset (data, 0, BLOCK_SECTOR_SIZE);
+      else
+        block_read_multi (fs_device, p->sectors[i], cnt, data);
+    }
+}
+
+/* Writes P's data to disk.  The caller marks it clean. */
+static void
+write_page (struct cached_page *p)
+{
+  size_t i, cnt;
+
+  for (i = 0; i < PAGE_SECTORS; i += cnt)
+    {
+      cnt = run_length (p, i);
+      if (p->sectors[i] != PAGE_NO_SECTOR)
+        block_write_multi (fs_device, p->sectors[i], cnt,
+                           p->kpage + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Returns a hash value for page P_. */
+static unsigned
+page_hash (const struct hash_elem *p_, void *aux UNUSED)
+{
+  const struct cached_page *p = hash_entry (p_, struct cached_page,
+                                            hash_elem);
+  return hash_int (p->inumber) ^ hash_int (p->index);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct cached_page *a = hash_entry (a_, struct cached_page,
+                                            hash_elem);
+  const struct cached_page *b = hash_entry (b_, struct cached_page,
+                                            hash_elem);
+
+  if (a->inumber != b->inumber)
+    return a->inumber < b->inumber;
+  return a->index < b->index;
+}
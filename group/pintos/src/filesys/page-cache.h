@@ -0,0 +1,50 @@
+#ifndef FILESYS_PAGE_CACHE_H
+#define FILESYS_PAGE_CACHE_H
+
+#include <hash.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+#include "threads/vaddr.h"
+
+/* Sectors in a page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A sector of a page that lies past the end of its file. */
+#define PAGE_NO_SECTOR ((block_sector_t) -1)
+
+/* A page of file data in the page cache. */
+struct cached_page
+  {
+    struct hash_elem hash_elem;         /* Element in page table. */
+    struct list_elem list_elem;         /* Element in clock list or
+                                           write-back list. */
+    block_sector_t inumber;             /* File's inode sector. */
+    size_t index;                       /* Page number within file. */
+    block_sector_t sectors[PAGE_SECTORS]; /* Disk sector of each part,
+                                           or PAGE_NO_SECTOR. */
+    uint8_t *kpage;                     /* Data, a kernel page. */
+    bool user;                          /* KPAGE from the user pool? */
+    bool dirty;                         /* Newer than the disk? */
+    bool reading;                       /* Being read in, so its data
+                                           is not valid yet? */
+    bool writing;                       /* Being written back by
+                                           page_cache_flush()? */
+    bool accessed;                      /* Used since the clock hand
+                                           last passed? */
+    int ref_cnt;                        /* References; never evicted
+                                           while nonzero. */
+  };
+
+void page_cache_init (void);
+struct cached_page *page_cache_lookup (block_sector_t inumber, size_t index);
+struct cached_page *page_cache_insert (block_sector_t inumber, size_t index,
+                                       const block_sector_t sectors[],
+                                       bool fill);
+void page_cache_release (struct cached_page *);
+void page_cache_mark_dirty (struct cached_page *);
+void page_cache_drop (block_sector_t inumber);
+void page_cache_flush (void);
+
+#endif /* filesys/page-cache.h */
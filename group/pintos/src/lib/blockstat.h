@@ -0,0 +1,33 @@
+#ifndef __LIB_BLOCKSTAT_H
+#define __LIB_BLOCKSTAT_H
+
+#include <stdint.h>
+
+/* Number of latency buckets in a `struct blockstat'.  Bucket I
+   counts requests that took from 2**I to 2**(I+1) - 1 CPU
+   cycles, except that the last one also counts slower ones. */
+#define BLOCKSTAT_BUCKETS 32
+
+/* I/O statistics for a block device, as returned by the
+   blockstat system call.  Times are in CPU cycles, as counted by
+   the time-stamp counter. */
+struct blockstat
+  {
+    uint64_t read_cnt;                  /* Sectors read. */
+    uint64_t write_cnt;                 /* Sectors written. */
+    uint64_t read_bytes;                /* Bytes read. */
+    uint64_t write_bytes;               /* Bytes written. */
+    uint64_t read_reqs;                 /* Read requests completed. */
+    uint64_t write_reqs;                /* Write requests completed. */
+    uint64_t read_lat[BLOCKSTAT_BUCKETS];  /* Read latencies. */
+    uint64_t write_lat[BLOCKSTAT_BUCKETS]; /* Write latencies. */
+    uint32_t depth;                     /* Requests now outstanding. */
+    uint32_t max_depth;                 /* Most requests outstanding. */
+    uint64_t depth_time;                /* Integral of depth over time;
+                                           divided by ELAPSED, the
+                                           average depth. */
+    uint64_t busy_time;                 /* Time with depth > 0. */
+    uint64_t elapsed;                   /* Time since registration. */
+  };
+
+#endif /* lib/blockstat.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Maximum length of a name in a `struct dirent'.
+   Matches NAME_MAX in the kernel and READDIR_MAX_LEN in the
+   user library. */
+#define DIRENT_NAME_MAX 14
+
+/* A directory entry as returned by the getdents system call. */
+struct dirent
+  {
+    int d_ino;                          /* Inode number. */
+    bool d_isdir;                       /* Is it a directory? */
+    char d_name[DIRENT_NAME_MAX + 1];   /* Null terminated file name. */
+  };
+
+#endif /* lib/dirent.h */
@@ -0,0 +1,11 @@
+#ifndef __LIB_FCNTL_H
+#define __LIB_FCNTL_H
+
+/* Commands for the fcntl system call. */
+#define F_GETFL 1               /* Return the file's flags. */
+#define F_SETFL 2               /* Set the file's flags to ARG. */
+
+/* File flags. */
+#define O_DIRECT 0x1            /* Bypass the buffer cache. */
+
+#endif /* lib/fcntl.h */
@@ -30,6 +30,9 @@ enum
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
     SYS_INUMBER,                 /* Returns the inode number for a fd. */
+    SYS_GETDENTS,               /* Reads many directory entries at once. */
+    SYS_BLOCKSTAT,              /* Reads a block device's I/O statistics. */
+    SYS_FCNTL,                  /* Gets or sets an open file's flags. */
     // testing system calls
     SYS_TEST_SIMPATH
   };
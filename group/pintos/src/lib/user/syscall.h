@@ -3,6 +3,9 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <dirent.h>
+#include <blockstat.h>
+#include <fcntl.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -33,6 +36,7 @@ int write (int fd, const void *buffer, unsigned length);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+int fcntl (int fd, int cmd, int arg);
 int practice (int i);
 
 /* Project 3 and optionally project 4. */
@@ -45,6 +49,8 @@ bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
+int getdents (int fd, struct dirent *, unsigned cnt, unsigned *cookie);
+bool blockstat (const char *device, struct blockstat *);
 // project 4 test
 bool simplify_path (char *path);
 
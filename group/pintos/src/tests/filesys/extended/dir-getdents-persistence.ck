@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({'x' => {'a' => [''], 'b' => [''], 'c' => [''], 'd' => [''],
+                        'sub' => {}}});
+pass;
@@ -0,0 +1,59 @@
+/* Lists a directory with getdents(), two entries per call, and
+   checks that every entry comes back exactly once with the right
+   inumber and type. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char *names[] = {"a", "b", "c", "d", "sub"};
+#define NAME_CNT (sizeof names / sizeof *names)
+
+void
+test_main (void)
+{
+  struct dirent ents[2];
+  bool seen[NAME_CNT];
+  unsigned cookie = 0;
+  size_t i;
+  int dir_fd, cnt, j;
+
+  CHECK (mkdir ("/x"), "mkdir \"/x\"");
+  CHECK (chdir ("/x"), "chdir \"/x\"");
+  for (i = 0; i + 1 < NAME_CNT; i++)
+    CHECK (create (names[i], 0), "create \"%s\"", names[i]);
+  CHECK (mkdir ("sub"), "mkdir \"sub\"");
+  CHECK ((dir_fd = open (".")) > 1, "open \".\"");
+
+  memset (seen, 0, sizeof seen);
+  while ((cnt = getdents (dir_fd, ents, 2, &cookie)) > 0)
+    for (j = 0; j < cnt; j++)
+      {
+        int fd;
+
+        for (i = 0; i < NAME_CNT; i++)
+          if (!strcmp (ents[j].d_name, names[i]))
+            break;
+        if (i == NAME_CNT)
+          fail ("unexpected entry \"%s\"", ents[j].d_name);
+        if (seen[i])
+          fail ("entry \"%s\" returned twice", names[i]);
+        seen[i] = true;
+
+        fd = open (names[i]);
+        if (fd < 2)
+          fail ("open \"%s\"", names[i]);
+        if (ents[j].d_ino != inumber (fd))
+          fail ("wrong inumber for \"%s\"", names[i]);
+        if (ents[j].d_isdir != isdir (fd))
+          fail ("wrong type for \"%s\"", names[i]);
+        close (fd);
+      }
+  CHECK (cnt == 0, "getdents reached end of directory");
+
+  for (i = 0; i < NAME_CNT; i++)
+    if (!seen[i])
+      fail ("entry \"%s\" missing", names[i]);
+  msg ("all %zu entries listed", NAME_CNT);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-getdents) begin
+(dir-getdents) mkdir "/x"
+(dir-getdents) chdir "/x"
+(dir-getdents) create "a"
+(dir-getdents) create "b"
+(dir-getdents) create "c"
+(dir-getdents) create "d"
+(dir-getdents) mkdir "sub"
+(dir-getdents) open "."
+(dir-getdents) getdents reached end of directory
+(dir-getdents) all 5 entries listed
+(dir-getdents) end
+EOF
+pass;
@@ -0,0 +1,78 @@
+/* The main thread and a reader thread both hold a reader-writer
+   lock for reading when a high-priority writer blocks on it.
+   The writer donates its priority to both readers.  The reader
+   releases its hold and drops back to its own priority, then
+   the main thread releases the lock and the writer runs. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+struct reader_data
+  {
+    struct rwlock *rwlock;
+    struct semaphore wake;
+  };
+
+static thread_func reader_thread_func;
+static thread_func writer_thread_func;
+
+void
+test_rwlock_donate_readers (void)
+{
+  struct rwlock rwlock;
+  struct reader_data reader;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rwlock_init (&rwlock, RWLOCK_PREFER_WRITERS);
+  rwlock_acquire_read (&rwlock);
+
+  reader.rwlock = &rwlock;
+  sema_init (&reader.wake, 0);
+  thread_create ("reader", PRI_DEFAULT + 1, reader_thread_func, &reader);
+
+  thread_create ("writer", PRI_DEFAULT + 3, writer_thread_func, &rwlock);
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+
+  sema_up (&reader.wake);
+  msg ("Reader should have just released the lock.");
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+
+  rwlock_release (&rwlock);
+  msg ("Writer should have just finished.");
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+reader_thread_func (void *reader_)
+{
+  struct reader_data *reader = reader_;
+
+  rwlock_acquire_read (reader->rwlock);
+  msg ("Reader acquired the lock for reading.");
+  sema_down (&reader->wake);
+  msg ("Reader should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+  rwlock_release (reader->rwlock);
+}
+
+static void
+writer_thread_func (void *rwlock_)
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_write (rwlock);
+  msg ("Writer acquired the lock for writing.");
+  rwlock_release (rwlock);
+  msg ("Writer finished.");
+}
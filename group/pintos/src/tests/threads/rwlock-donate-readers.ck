@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-donate-readers) begin
+(rwlock-donate-readers) Reader acquired the lock for reading.
+(rwlock-donate-readers) Main thread should have priority 34.  Actual priority: 34.
+(rwlock-donate-readers) Reader should have priority 34.  Actual priority: 34.
+(rwlock-donate-readers) Reader should have just released the lock.
+(rwlock-donate-readers) Main thread should have priority 34.  Actual priority: 34.
+(rwlock-donate-readers) Writer acquired the lock for writing.
+(rwlock-donate-readers) Writer finished.
+(rwlock-donate-readers) Writer should have just finished.
+(rwlock-donate-readers) Main thread should have priority 31.  Actual priority: 31.
+(rwlock-donate-readers) end
+EOF
+pass;
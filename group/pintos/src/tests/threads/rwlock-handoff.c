@@ -0,0 +1,71 @@
+/* The main thread holds a reader-writer lock for writing while
+   reader 1, a writer, and reader 2 block on it, in that order
+   and at increasing priorities.  When the main thread releases
+   the lock, a lock that prefers writers hands it to the writer
+   first, whereas a phase-fair lock hands it to both readers,
+   because the previous holder was a writer. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread_func;
+static thread_func writer_thread_func;
+static void handoff (enum rwlock_policy);
+
+void
+test_rwlock_handoff (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  msg ("Preferring writers:");
+  handoff (RWLOCK_PREFER_WRITERS);
+  msg ("Phase-fair:");
+  handoff (RWLOCK_PHASE_FAIR);
+}
+
+static void
+handoff (enum rwlock_policy policy)
+{
+  struct rwlock rwlock;
+
+  rwlock_init (&rwlock, policy);
+  rwlock_acquire_write (&rwlock);
+
+  thread_create ("reader 1", PRI_DEFAULT + 1, reader_thread_func, &rwlock);
+  thread_create ("writer", PRI_DEFAULT + 2, writer_thread_func, &rwlock);
+  thread_create ("reader 2", PRI_DEFAULT + 3, reader_thread_func, &rwlock);
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 3, thread_get_priority ());
+
+  rwlock_release (&rwlock);
+  msg ("All threads should have just finished.");
+  msg ("Main thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+reader_thread_func (void *rwlock_)
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_read (rwlock);
+  msg ("Thread %s acquired the lock for reading.", thread_name ());
+  rwlock_release (rwlock);
+}
+
+static void
+writer_thread_func (void *rwlock_)
+{
+  struct rwlock *rwlock = rwlock_;
+
+  rwlock_acquire_write (rwlock);
+  msg ("Thread %s acquired the lock for writing.", thread_name ());
+  rwlock_release (rwlock);
+}
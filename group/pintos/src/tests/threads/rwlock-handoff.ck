@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-handoff) begin
+(rwlock-handoff) Preferring writers:
+(rwlock-handoff) Main thread should have priority 34.  Actual priority: 34.
+(rwlock-handoff) Thread writer acquired the lock for writing.
+(rwlock-handoff) Thread reader 2 acquired the lock for reading.
+(rwlock-handoff) Thread reader 1 acquired the lock for reading.
+(rwlock-handoff) All threads should have just finished.
+(rwlock-handoff) Main thread should have priority 31.  Actual priority: 31.
+(rwlock-handoff) Phase-fair:
+(rwlock-handoff) Main thread should have priority 34.  Actual priority: 34.
+(rwlock-handoff) Thread reader 2 acquired the lock for reading.
+(rwlock-handoff) Thread reader 1 acquired the lock for reading.
+(rwlock-handoff) Thread writer acquired the lock for writing.
+(rwlock-handoff) All threads should have just finished.
+(rwlock-handoff) Main thread should have priority 31.  Actual priority: 31.
+(rwlock-handoff) end
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Measures the cost of creating a thread that runs to
+   completion, both when the new thread outranks its creator and
+   preempts it at once, and when it has the same priority and
+   runs only once the creator blocks.
+
+   This is a benchmark rather than a pass/fail test: the cycle
+   counts it reports depend on the CPU and the emulator, so it is
+   not part of the graded test set.  Run it with "run
+   thread-churn". */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* Threads created per measurement. */
+#define CHURN_CNT 500
+
+static thread_func churn_thread;
+static void measure (const char *what, int priority);
+
+void
+test_thread_churn (void)
+{
+  measure ("higher priority", PRI_DEFAULT + 1);
+  measure ("same priority", PRI_DEFAULT);
+}
+
+/* Creates CHURN_CNT threads with the given PRIORITY, one after
+   another, waiting for each to finish before creating the
+   next, and reports the average cost of each. */
+static void
+measure (const char *what, int priority)
+{
+  struct semaphore done;
+  uint64_t start, cycles;
+  int i;
+
+  sema_init (&done, 0);
+  start = timer_cycles ();
+  for (i = 0; i < CHURN_CNT; i++)
+    {
+      if (thread_create ("churn", priority, churn_thread, &done)
+          == TID_ERROR)
+        fail ("thread_create failed after %d threads", i);
+      sema_down (&done);
+    }
+  cycles = timer_cycles () - start;
+  msg ("%s: %d threads, %llu cycles per create and exit",
+       what, CHURN_CNT, cycles / CHURN_CNT);
+}
+
+static void
+churn_thread (void *done_)
+{
+  struct semaphore *done = done_;
+
+  sema_up (done);
+}
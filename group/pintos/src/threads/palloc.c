@@ -23,7 +23,12 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Caches may keep pages that nobody else is using and register a
+   shrinker to give them back.  When a pool runs out of pages,
+   the allocator asks the shrinkers to free some before it gives
+   up. */
 
 /* A memory pool. */
 struct pool
@@ -36,9 +41,13 @@ struct pool
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Registered shrinkers. */
+static struct list shrinkers = LIST_INITIALIZER (shrinkers);
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static bool shrink (enum palloc_flags, size_t page_cnt);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -61,12 +70,22 @@ palloc_init (size_t user_page_limit)
              user_pages, "user pool");
 }
 
+/* Registers SHRINKER, to be called when a pool runs out of
+   pages. */
+void
+palloc_register_shrinker (struct palloc_shrinker *shrinker)
+{
+  list_push_back (&shrinkers, &shrinker->elem);
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   otherwise from the kernel pool.  If there are too few, first
+   has the registered shrinkers free pages in that pool.  If
+   PAL_ZERO is set in FLAGS, then the pages are filled with
+   zeros.  If too few pages are available, returns a null
+   pointer, unless PAL_ASSERT is set in FLAGS, in which case the
+   kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
@@ -77,9 +96,13 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  do
+    {
+      lock_acquire (&pool->lock);
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      lock_release (&pool->lock);
+    }
+  while (page_idx == BITMAP_ERROR && shrink (flags, page_cnt));
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -164,7 +187,7 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
+  lock_init_named (&p->lock, name);
   p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
   p->base = base + bm_pages * PGSIZE;
 }
@@ -180,3 +203,24 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Asks the registered shrinkers to free PAGE_CNT pages in the
+   pool that FLAGS selects.  Returns true if any page was freed,
+   so that an allocation is worth retrying. */
+static bool
+shrink (enum palloc_flags flags, size_t page_cnt)
+{
+  struct list_elem *e;
+  size_t freed = 0;
+
+  for (e = list_begin (&shrinkers); e != list_end (&shrinkers);
+       e = list_next (e))
+    {
+      struct palloc_shrinker *s = list_entry (e, struct palloc_shrinker,
+                                              elem);
+      freed += s->shrink (flags, page_cnt);
+      if (freed >= page_cnt)
+        break;
+    }
+  return freed > 0;
+}
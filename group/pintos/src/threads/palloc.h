@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <list.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,7 +12,20 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* A cache that can give pages back to the page allocator when
+   memory runs short. */
+struct palloc_shrinker
+  {
+    struct list_elem elem;              /* Element in shrinker list. */
+
+    /* Frees up to PAGE_CNT pages in the pool that FLAGS selects
+       and returns the number freed.  Called without any palloc
+       lock held, possibly by a thread already inside the cache. */
+    size_t (*shrink) (enum palloc_flags flags, size_t page_cnt);
+  };
+
 void palloc_init (size_t user_page_limit);
+void palloc_register_shrinker (struct palloc_shrinker *);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
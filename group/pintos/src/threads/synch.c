@@ -27,13 +27,54 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "devices/timer.h"
 
 static void reorder_waiters(struct thread*);
-static void donate_nest(struct thread*);
+static void donate (struct lock *);
+static void waiter_raised (struct thread *);
+static void rwlock_donate (struct rwlock *);
+
+/* Contention statistics for all the locks with a given name.
+
+   Locks are profiled by name rather than individually, because
+   a lock may be freed at any time without notice, and so that
+   like locks, such as those of every thread's file table, add
+   up.  A lock is tied to its class when it is first acquired
+   with profiling on, so naming costs nothing otherwise.  All
+   times are in CPU cycles. */
+struct lock_class
+  {
+    const char *name;           /* Lock name. */
+    uint64_t acquired;          /* Number of acquisitions. */
+    uint64_t contended;         /* Acquisitions that had to wait. */
+    uint64_t wait_total;        /* Total time spent waiting. */
+    uint64_t wait_max;          /* Longest wait. */
+    uint64_t hold_max;          /* Longest time held. */
+  };
+
+/* Lock classes.  If there are more names than this, the rest
+   share the last class. */
+#define LOCK_CLASS_MAX 64
+static struct lock_class lock_classes[LOCK_CLASS_MAX];
+static size_t lock_class_cnt;
+
+bool lock_profiling;
+
+static void lock_account (struct lock *, bool contended, uint64_t start);
+
+/* Number of threads that have started to wait for a lock or
+   reader-writer lock, used to keep turnstiles FIFO among waiters
+   of equal priority. */
+static unsigned wait_seq;
+static struct thread *turnstile_meld (struct thread *, struct thread *);
+static struct thread *turnstile_pop (struct thread *);
+static struct thread *turnstile_raise (struct thread *, struct thread *);
 static bool waiter_priority_cmp(const struct list_elem *a,
         const struct list_elem *b, void *aux);
 
@@ -188,16 +229,28 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   Threads waiting for a lock wait in its turnstile, a priority
+   queue from which lock_release() hands the lock directly to the
+   highest-priority waiter, FIFO among equals.  While a lock has
+   waiters, the priority of the first one is donated to the
+   holder.  Each thread counts the donations it receives per
+   priority level (see thread_donate()), so its effective
+   priority is found in constant time however many locks it
+   holds.  Interrupts must be off to access a lock's fields. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name)
 {
   ASSERT (lock != NULL);
+  ASSERT (name != NULL);
 
-  lock->highest_priority = PRI_MIN;
   lock->holder = NULL;
-  sema_init (&lock->semaphore, 1);
-  sema_init (&lock->holder_sema, 1);
+  lock->waiters = NULL;
+  lock->donation = -1;
+  lock->name = name[0] == '&' ? name + 1 : name;
+  lock->class = NULL;
+  lock->acquired_at = 0;
 }
 
 // thread's priority become higher, so we have to
@@ -222,17 +275,62 @@ reorder_waiters(struct thread *t)
    }
 }
 
-// Recursively update priority
-void
-donate_nest(struct thread *t)
+/* Updates the donation from LOCK's turnstile to its holder after
+   a waiter arrived or gained priority, and passes any resulting
+   increase in the holder's priority along the chain of locks
+   that it, in turn, is waiting for.  Interrupts must be off. */
+static void
+donate (struct lock *lock)
 {
-    struct lock *l = t->waiting;
+  struct thread *holder = lock->holder;
+  int top = lock->waiters->ts_priority;
+  int old_priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs || top <= lock->donation)
+    return;
+  if (lock->donation >= 0)
+    thread_undonate (holder, lock->donation);
+  thread_donate (holder, top);
+  lock->donation = top;
+
+  old_priority = holder->priority;
+  thread_update_priority (holder);
+  if (holder->priority > old_priority)
+    {
+      trace (TRACE_DONATE, holder->tid, lock->waiters->tid, holder->priority);
+      waiter_raised (holder);
+    }
+}
 
-    if (l != NULL && t->priority > l->holder->priority) {
-        l->holder->priority = t->priority;
-        reorder_waiters(l->holder);
-        donate_nest(l->holder);
+/* Called when blocked thread T has gained priority by donation.
+   Moves T up in whatever it waits in, and if that is a lock or
+   reader-writer lock, passes the priority on to its holders.
+   Interrupts must be off. */
+static void
+waiter_raised (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->waiting != NULL)
+    {
+      t->ts_priority = t->priority;
+      t->waiting->waiters = turnstile_raise (t->waiting->waiters, t);
+      donate (t->waiting);
+    }
+  else if (t->waiting_rw != NULL)
+    {
+      struct rwlock *rw = t->waiting_rw;
+      t->ts_priority = t->priority;
+      if (t->waiting_write)
+        rw->writers = turnstile_raise (rw->writers, t);
+      else
+        rw->readers = turnstile_raise (rw->readers, t);
+      rwlock_donate (rw);
     }
+  else
+    reorder_waiters (t);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
@@ -246,30 +344,36 @@ donate_nest(struct thread *t)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  uint64_t start = lock_profiling ? timer_cycles () : 0;
+  bool contended;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
-  struct thread *cur = thread_current();
-
-  sema_down (&lock->holder_sema);
-  cur->waiting = lock;
-  // priority donate
-  if (lock->holder != NULL && !thread_mlfqs
-          && cur->priority > lock->holder->priority)
-  {
-      lock->holder->priority = cur->priority;
-      reorder_waiters(lock->holder);
-      donate_nest(lock->holder);
-  }
-  if (cur->priority > lock->highest_priority)
-      lock->highest_priority = cur->priority;
-  sema_up (&lock->holder_sema);
-  sema_down (&lock->semaphore);
-  cur->waiting = NULL;
-  lock->holder = cur;
-  list_push_front(&cur->holdings, &lock->elem);
-  lock->holder_priority = cur->priority;
+  old_level = intr_disable ();
+  contended = lock->holder != NULL;
+  if (!contended)
+    lock->holder = cur;
+  else
+    {
+      /* Wait in the turnstile.  lock_release() makes us the
+         holder before waking us up. */
+      cur->waiting = lock;
+      cur->ts_priority = cur->priority;
+      cur->ts_seq = wait_seq++;
+      cur->ts_child = cur->ts_sibling = cur->ts_prev = NULL;
+      lock->waiters = turnstile_meld (lock->waiters, cur);
+      trace (TRACE_LOCK_BLOCK, cur->tid, lock->holder->tid, (uintptr_t) lock);
+      donate (lock);
+      thread_block ();
+      ASSERT (lock->holder == cur);
+    }
+  if (lock_profiling)
+    lock_account (lock, contended, start);
+  intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -281,14 +385,21 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
+  old_level = intr_disable ();
+  success = lock->holder == NULL;
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      if (lock_profiling)
+        lock_account (lock, false, 0);
+    }
+  intr_set_level (old_level);
   return success;
 }
 
@@ -300,37 +411,51 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  struct thread *next = NULL;
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  // if (!list_empty(&lock->semaphore.waiters)) {
-  //   struct thread *t = list_entry(&lock->semaphore.waiters.head,
-  //           struct thread, elem);
-  //   lock->holder->priority = t->priority;
-  // }
-  // else
-  //
-  struct list_elem *e;
-  struct lock *l;
-  int next_p = lock->holder_priority;
-
-  for (e = list_begin(&lock->holder->holdings);
-          e != list_end(&lock->holder->holdings);
-          e = list_next(e)) {
-    l = list_entry(e, struct lock, elem);
-    if (l == lock) {
-        list_remove(e);
-        continue;
+  old_level = intr_disable ();
+  if (lock_profiling && lock->acquired_at != 0)
+    {
+      uint64_t held = timer_cycles () - lock->acquired_at;
+      if (held > lock->class->hold_max)
+        lock->class->hold_max = held;
+      lock->acquired_at = 0;
     }
-    if (!list_empty(&l->semaphore.waiters)) {
-        if (l->highest_priority > next_p)
-            next_p = l->highest_priority;
+  if (lock->donation >= 0)
+    {
+      thread_undonate (cur, lock->donation);
+      lock->donation = -1;
+      thread_update_priority (cur);
     }
-  }
-  lock->holder->priority = next_p;
   lock->holder = NULL;
-  sema_up (&lock->semaphore);
-  thread_yield();
+
+  if (lock->waiters != NULL)
+    {
+      /* Hand the lock to the first waiter, which inherits the
+         donation from those still waiting. */
+      next = lock->waiters;
+      lock->waiters = turnstile_pop (next);
+      lock->holder = next;
+      next->waiting = NULL;
+      trace (TRACE_LOCK_HANDOFF, next->tid, cur->tid, (uintptr_t) lock);
+      if (lock->waiters != NULL && !thread_mlfqs)
+        {
+          lock->donation = lock->waiters->ts_priority;
+          thread_donate (next, lock->donation);
+          thread_update_priority (next);
+        }
+      thread_unblock (next);
+    }
+  intr_set_level (old_level);
+
+  /* Let the new holder run at once if it outranks us. */
+  if (next != NULL && next->priority > cur->priority)
+    thread_yield ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -344,6 +469,490 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Records that LOCK has just been acquired, after waiting since
+   START if CONTENDED is true.  Interrupts must be off. */
+static void
+lock_account (struct lock *lock, bool contended, uint64_t start)
+{
+  struct lock_class *c = lock->class;
+  uint64_t now = timer_cycles ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c == NULL)
+    {
+      for (c = lock_classes; c < lock_classes + lock_class_cnt; c++)
+        if (!strcmp (c->name, lock->name))
+          break;
+      if (c == lock_classes + LOCK_CLASS_MAX)
+        c--;
+      else if (c == lock_classes + lock_class_cnt)
+        {
+          c->name = (lock_class_cnt < LOCK_CLASS_MAX - 1
+                     ? lock->name : "(other)");
+          lock_class_cnt++;
+        }
+      lock->class = c;
+    }
+
+  c->acquired++;
+  if (contended)
+    {
+      uint64_t wait = now - start;
+      c->contended++;
+      c->wait_total += wait;
+      if (wait > c->wait_max)
+        c->wait_max = wait;
+    }
+  lock->acquired_at = now;
+}
+
+/* Prints the most contended locks, if profiling is on. */
+void
+lock_print_stats (void)
+{
+  struct lock_class *top[10];
+  size_t top_cnt = 0;
+  size_t contended_cnt = 0;
+  size_t i, j;
+
+  if (!lock_profiling)
+    return;
+
+  /* Insertion sort by contended acquisitions, keeping the top
+     few. */
+  for (i = 0; i < lock_class_cnt; i++)
+    {
+      struct lock_class *c = &lock_classes[i];
+      if (c->contended == 0)
+        continue;
+      contended_cnt++;
+      for (j = top_cnt; j > 0 && top[j - 1]->contended < c->contended; j--)
+        if (j < sizeof top / sizeof *top)
+          top[j] = top[j - 1];
+      if (j < sizeof top / sizeof *top)
+        {
+          top[j] = c;
+          if (top_cnt < sizeof top / sizeof *top)
+            top_cnt++;
+        }
+    }
+
+  printf ("Locks: %zu names profiled, %zu contended%s\n",
+          lock_class_cnt, contended_cnt,
+          top_cnt > 0 ? ", most contended (times in cycles):" : "");
+  for (i = 0; i < top_cnt; i++)
+    {
+      struct lock_class *c = top[i];
+      printf ("  %s: %"PRIu64" acquired, %"PRIu64" contended, "
+              "wait avg %"PRIu64" max %"PRIu64", hold max %"PRIu64"\n",
+              c->name, c->acquired, c->contended,
+              c->wait_total / c->contended, c->wait_max, c->hold_max);
+    }
+}
+
+/* Initializes RW as a reader-writer lock with the given
+   POLICY.  Any number of readers, or a single writer, may hold
+   a reader-writer lock at once.
+
+   Readers and writers that must wait do so in two turnstiles,
+   ordered by priority.  A reader must wait while a writer holds
+   the lock or is waiting for it, so a stream of readers cannot
+   starve writers.  When the last holder releases the lock, it
+   goes to the first waiting writer or to all waiting readers:
+   with RWLOCK_PREFER_WRITERS, writers always go first, and with
+   RWLOCK_PHASE_FAIR, the waiting readers go first after a
+   writer, and a writer first after readers, so neither side can
+   starve the other.
+
+   The highest priority of any waiter is donated to every
+   current holder, readers included.  A thread may hold at most
+   RWLOCK_HOLD_MAX reader-writer locks at once. */
+void
+rwlock_init (struct rwlock *rw, enum rwlock_policy policy)
+{
+  ASSERT (rw != NULL);
+
+  rw->policy = policy;
+  list_init (&rw->holders);
+  rw->holder_cnt = 0;
+  rw->write_held = false;
+  rw->readers = NULL;
+  rw->writers = NULL;
+  rw->donation = -1;
+}
+
+/* Returns T's hold on RW, or if RW is null, an unused hold, or
+   a null pointer if there is none. */
+static struct rwlock_hold *
+find_hold (struct thread *t, const struct rwlock *rw)
+{
+  int i;
+
+  for (i = 0; i < RWLOCK_HOLD_MAX; i++)
+    if (t->rw_holds[i].rwlock == rw)
+      return &t->rw_holds[i];
+  return NULL;
+}
+
+/* Returns true if a thread may take RW for writing if WRITE is
+   true, or for reading otherwise, without waiting. */
+static bool
+rwlock_available (const struct rwlock *rw, bool write)
+{
+  if (write)
+    return rw->holder_cnt == 0;
+  return !rw->write_held && rw->writers == NULL;
+}
+
+/* Makes T a holder of RW, for writing if WRITE is true, for
+   reading otherwise.  Interrupts must be off. */
+static void
+rwlock_grant (struct rwlock *rw, struct thread *t, bool write)
+{
+  struct rwlock_hold *h = find_hold (t, NULL);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (h != NULL);
+
+  h->rwlock = rw;
+  h->thread = t;
+  list_push_back (&rw->holders, &h->elem);
+  rw->holder_cnt++;
+  rw->write_held = write;
+  if (rw->donation >= 0)
+    {
+      thread_donate (t, rw->donation);
+      thread_update_priority (t);
+    }
+}
+
+/* Brings the donation from RW's waiters to each of its holders
+   up to date, and passes any increase in a holder's priority on
+   to whatever it waits for.  Interrupts must be off. */
+static void
+rwlock_donate (struct rwlock *rw)
+{
+  struct list_elem *e;
+  struct thread *donor = NULL;
+  int top = -1;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
+    return;
+  if (rw->readers != NULL)
+    donor = rw->readers;
+  if (rw->writers != NULL
+      && (donor == NULL || rw->writers->ts_priority > donor->ts_priority))
+    donor = rw->writers;
+  if (donor != NULL)
+    top = donor->ts_priority;
+  if (top == rw->donation)
+    return;
+
+  for (e = list_begin (&rw->holders); e != list_end (&rw->holders);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct rwlock_hold, elem)->thread;
+      if (rw->donation >= 0)
+        thread_undonate (t, rw->donation);
+      if (top >= 0)
+        thread_donate (t, top);
+    }
+  rw->donation = top;
+
+  for (e = list_begin (&rw->holders); e != list_end (&rw->holders);
+       e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct rwlock_hold, elem)->thread;
+      int old_priority = t->priority;
+      thread_update_priority (t);
+      if (t->priority > old_priority)
+        {
+          trace (TRACE_DONATE, t->tid, donor->tid, t->priority);
+          waiter_raised (t);
+        }
+    }
+}
+
+/* Acquires RW for writing if WRITE is true, for reading
+   otherwise, sleeping until it becomes available if
+   necessary. */
+static void
+rwlock_acquire (struct rwlock *rw, bool write)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+  if (rwlock_available (rw, write))
+    rwlock_grant (rw, cur, write);
+  else
+    {
+      /* Wait in a turnstile.  rwlock_release() makes us a holder
+         before waking us up. */
+      cur->waiting_rw = rw;
+      cur->waiting_write = write;
+      cur->ts_priority = cur->priority;
+      cur->ts_seq = wait_seq++;
+      cur->ts_child = cur->ts_sibling = cur->ts_prev = NULL;
+      if (write)
+        rw->writers = turnstile_meld (rw->writers, cur);
+      else
+        rw->readers = turnstile_meld (rw->readers, cur);
+      rwlock_donate (rw);
+      thread_block ();
+      ASSERT (find_hold (cur, rw) != NULL);
+    }
+  intr_set_level (old_level);
+}
+
+/* Acquires RW for reading, sleeping until it becomes available
+   if necessary.  The current thread must not hold RW already.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  rwlock_acquire (rw, false);
+}
+
+/* Acquires RW for writing, sleeping until it becomes available
+   if necessary.  The current thread must not hold RW already.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  rwlock_acquire (rw, true);
+}
+
+/* Tries to acquire RW for writing if WRITE is true, for reading
+   otherwise, without sleeping.  Returns true if successful. */
+static bool
+rwlock_try_acquire (struct rwlock *rw, bool write)
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rw != NULL);
+  ASSERT (!rwlock_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+  success = rwlock_available (rw, write);
+  if (success)
+    rwlock_grant (rw, thread_current (), write);
+  intr_set_level (old_level);
+  return success;
+}
+
+/* Tries to acquire RW for reading and returns true if successful
+   or false on failure.  The current thread must not hold RW
+   already. */
+bool
+rwlock_try_acquire_read (struct rwlock *rw)
+{
+  return rwlock_try_acquire (rw, false);
+}
+
+/* Tries to acquire RW for writing and returns true if successful
+   or false on failure.  The current thread must not hold RW
+   already. */
+bool
+rwlock_try_acquire_write (struct rwlock *rw)
+{
+  return rwlock_try_acquire (rw, true);
+}
+
+/* Releases RW, which the current thread must hold for reading
+   or writing. */
+void
+rwlock_release (struct rwlock *rw)
+{
+  struct thread *cur = thread_current ();
+  struct rwlock_hold *h;
+  enum intr_level old_level;
+  int woken_priority = -1;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  h = find_hold (cur, rw);
+  ASSERT (h != NULL);
+  list_remove (&h->elem);
+  h->rwlock = NULL;
+  rw->holder_cnt--;
+  if (rw->donation >= 0)
+    {
+      thread_undonate (cur, rw->donation);
+      thread_update_priority (cur);
+    }
+
+  if (rw->holder_cnt == 0)
+    {
+      bool was_write = rw->write_held;
+
+      rw->write_held = false;
+      rw->donation = -1;
+      if (rw->writers != NULL
+          && (rw->readers == NULL || !was_write
+              || rw->policy == RWLOCK_PREFER_WRITERS))
+        {
+          struct thread *t = rw->writers;
+          rw->writers = turnstile_pop (t);
+          t->waiting_rw = NULL;
+          rwlock_grant (rw, t, true);
+          thread_unblock (t);
+          woken_priority = t->priority;
+        }
+      else
+        while (rw->readers != NULL)
+          {
+            struct thread *t = rw->readers;
+            rw->readers = turnstile_pop (t);
+            t->waiting_rw = NULL;
+            rwlock_grant (rw, t, false);
+            thread_unblock (t);
+            if (t->priority > woken_priority)
+              woken_priority = t->priority;
+          }
+
+      /* The new holders also receive the donation from those
+         still waiting. */
+      rwlock_donate (rw);
+      if (rw->donation > woken_priority)
+        woken_priority = rw->donation;
+    }
+  intr_set_level (old_level);
+
+  /* Let a new holder run at once if it outranks us. */
+  if (woken_priority > cur->priority)
+    thread_yield ();
+}
+
+/* Returns true if the current thread holds RW, for reading or
+   writing. */
+bool
+rwlock_held_by_current_thread (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return find_hold (thread_current (), rw) != NULL;
+}
+
+/* Turnstiles.
+
+   A lock's turnstile is a pairing heap of the threads waiting
+   for it, linked through their ts_* members and ordered by
+   ts_priority, then by ts_seq, the order in which they started
+   to wait.  A waiter's ts_priority is its priority when it
+   started to wait, raised by donation as it waits, so the heap
+   stays ordered even if the MLFQS changes the waiter's actual
+   priority.  Insertion and raising a waiter take constant time,
+   and removing the first waiter O(log n) amortized time. */
+
+/* Returns true if waiter A should get the lock before B. */
+static bool
+turnstile_before (const struct thread *a, const struct thread *b)
+{
+  if (a->ts_priority != b->ts_priority)
+    return a->ts_priority > b->ts_priority;
+  return (int) (a->ts_seq - b->ts_seq) < 0;
+}
+
+/* Melds the turnstile heaps rooted at A and B, either of which
+   may be empty, and returns the new root. */
+static struct thread *
+turnstile_meld (struct thread *a, struct thread *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (turnstile_before (b, a))
+    {
+      struct thread *t = a;
+      a = b;
+      b = t;
+    }
+
+  /* Make B the first child of A. */
+  b->ts_sibling = a->ts_child;
+  if (a->ts_child != NULL)
+    a->ts_child->ts_prev = b;
+  b->ts_prev = a;
+  a->ts_child = b;
+  a->ts_sibling = a->ts_prev = NULL;
+  return a;
+}
+
+/* Removes ROOT from its turnstile heap and returns the new root,
+   or a null pointer if the heap is now empty. */
+static struct thread *
+turnstile_pop (struct thread *root)
+{
+  struct thread *t = root->ts_child;
+  struct thread *pairs = NULL;
+  struct thread *new_root = NULL;
+
+  /* Meld the children in pairs from left to right, stacking the
+     results... */
+  while (t != NULL)
+    {
+      struct thread *a = t;
+      struct thread *b = a->ts_sibling;
+      struct thread *pair;
+
+      t = b != NULL ? b->ts_sibling : NULL;
+      a->ts_sibling = a->ts_prev = NULL;
+      if (b != NULL)
+        b->ts_sibling = b->ts_prev = NULL;
+      pair = turnstile_meld (a, b);
+      pair->ts_sibling = pairs;
+      pairs = pair;
+    }
+
+  /* ...then meld the pairs from right to left. */
+  while (pairs != NULL)
+    {
+      struct thread *pair = pairs;
+      pairs = pair->ts_sibling;
+      pair->ts_sibling = NULL;
+      new_root = turnstile_meld (new_root, pair);
+    }
+
+  root->ts_child = NULL;
+  return new_root;
+}
+
+/* Restores the order of the turnstile heap rooted at ROOT after
+   the ts_priority of its member T has been raised, and returns
+   the new root. */
+static struct thread *
+turnstile_raise (struct thread *root, struct thread *t)
+{
+  if (t == root)
+    return root;
+
+  /* Cut T's subtree out of the heap and meld it back in. */
+  if (t->ts_prev->ts_child == t)
+    t->ts_prev->ts_child = t->ts_sibling;
+  else
+    t->ts_prev->ts_sibling = t->ts_sibling;
+  if (t->ts_sibling != NULL)
+    t->ts_sibling->ts_prev = t->ts_prev;
+  t->ts_sibling = t->ts_prev = NULL;
+  return turnstile_meld (root, t);
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem
   {
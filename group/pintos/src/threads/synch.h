@@ -3,6 +3,7 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* A counting semaphore. */
 struct semaphore
@@ -20,20 +21,66 @@ void sema_self_test (void);
 /* Lock. */
 struct lock
   {
-    struct list_elem elem;
-    int highest_priority; // highest priority in waiting threads
-    struct thread *holder;      /* Thread holding lock (for debugging). */
-    struct semaphore semaphore; /* Binary semaphore controlling access. */
-    int holder_priority; // lock holder priority before any donation
-    struct semaphore holder_sema; // semaphore for protect donation
-                                  // on holder
+    struct thread *holder;      /* Thread holding lock. */
+    struct thread *waiters;     /* Turnstile of waiting threads. */
+    int donation;               /* Priority donated to holder, or -1. */
+    const char *name;           /* Name, for profiling. */
+    struct lock_class *class;   /* Profile, once first acquired. */
+    uint64_t acquired_at;       /* Cycle count when acquired. */
   };
 
-void lock_init (struct lock *);
+/* If true, gather lock contention statistics.
+   Controlled by kernel command-line option "-lockprof". */
+extern bool lock_profiling;
+
+/* Initializes LOCK, naming it after the expression that
+   designates it, e.g. "tid_lock" for lock_init (&tid_lock). */
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK)
+
+void lock_init_named (struct lock *, const char *name);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
+
+/* Reader-writer lock policies. */
+enum rwlock_policy
+  {
+    RWLOCK_PREFER_WRITERS,      /* Waiting writers go first. */
+    RWLOCK_PHASE_FAIR           /* Readers and writers alternate. */
+  };
+
+/* Reader-writer lock. */
+struct rwlock
+  {
+    enum rwlock_policy policy;  /* Policy. */
+    struct list holders;        /* struct rwlock_hold of holders. */
+    int holder_cnt;             /* Number of holders. */
+    bool write_held;            /* Held by a writer? */
+    struct thread *readers;     /* Turnstile of waiting readers. */
+    struct thread *writers;     /* Turnstile of waiting writers. */
+    int donation;               /* Priority donated to holders, or -1. */
+  };
+
+/* A thread's hold on a reader-writer lock.  Each thread has
+   RWLOCK_HOLD_MAX of these, so it may hold that many
+   reader-writer locks at once. */
+#define RWLOCK_HOLD_MAX 4
+struct rwlock_hold
+  {
+    struct list_elem elem;      /* Element in rwlock's holders. */
+    struct rwlock *rwlock;      /* Lock held, or null if unused. */
+    struct thread *thread;      /* Holding thread. */
+  };
+
+void rwlock_init (struct rwlock *, enum rwlock_policy);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+bool rwlock_try_acquire_read (struct rwlock *);
+bool rwlock_try_acquire_write (struct rwlock *);
+void rwlock_release (struct rwlock *);
+bool rwlock_held_by_current_thread (const struct rwlock *);
 
 /* Condition variable. */
 struct condition
@@ -11,9 +11,9 @@
 #include "threads/malloc.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
-#include "filesys/directory.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -23,19 +23,53 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queue of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+   There is a FIFO of ready threads for each priority, and bit P
+   of ready_mask is set just when the FIFO for priority P is
+   nonempty, so that the highest priority with a ready thread is
+   the mask's most significant set bit.  Adding, removing, and
+   re-prioritizing a ready thread, and finding the next thread to
+   run, all take constant time.  Both the priority scheduler and
+   the MLFQS use it.  Interrupts must be off to access it. */
+static struct list ready_queues[PRI_MAX - PRI_MIN + 1];
+static uint64_t ready_mask;
+static size_t ready_cnt;        /* Number of ready threads. */
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-// list of sleeping threads
-static struct list sleep_list;
+/* Sleeping threads, as a binary min-heap of pointers to the
+   sleepers' stack-allocated entries ordered by wakeup time, so
+   that sleep_heap[0] is always the earliest deadline.  The array
+   grows by doubling; it is only ever reallocated from thread
+   context, in thread_sleep().  Interrupts must be off to access
+   it. */
+static struct sleep_thread_entry **sleep_heap;
+static size_t sleep_cnt;        /* Number of sleeping threads. */
+static size_t sleep_cap;        /* Capacity of sleep_heap. */
 
 fixed_point_t load_avg;
 
+/* Threads whose recent_cpu was charged a tick since the last
+   4-tick priority recomputation.  Only the running thread is
+   charged on each tick, so at most 4 distinct threads can appear
+   here.  Interrupts must be off to access it. */
+static struct thread *charged[4];
+static size_t charged_cnt;
+
+/* Pages of exited threads, kept for reuse by thread_create()
+   so that short-lived threads don't go through the page
+   allocator.  Linked through struct thread's `elem'.  At most
+   THREAD_POOL_MAX pages are kept, and the pool gives them back
+   to the page allocator through its shrinker when the kernel
+   pool runs low.  Interrupts must be off to access it. */
+#define THREAD_POOL_MAX 16
+static struct list thread_pool;
+static size_t thread_pool_cnt;
+static struct palloc_shrinker thread_pool_shrinker;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -67,8 +101,6 @@ static unsigned thread_ticks;   /* # of timer ticks since last yield. */
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
-static struct list mlfqs_lists[PRI_MAX - PRI_MIN + 1];
-
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
@@ -81,6 +113,12 @@ static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
 static int mlfqs_get_priority (struct thread *t);
+static void mlfqs_forget (struct thread *t);
+static size_t thread_pool_shrink (enum palloc_flags, size_t page_cnt);
+static int highest_priority (uint64_t mask);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static struct thread *ready_pop (void);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -98,21 +136,20 @@ static int mlfqs_get_priority (struct thread *t);
 void
 thread_init (void)
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&ready_queues[i]);
   list_init (&all_list);
-  list_init (&sleep_list);
+  list_init (&thread_pool);
+  thread_pool_shrinker.shrink = thread_pool_shrink;
+  palloc_register_shrinker (&thread_pool_shrinker);
   // sema_init (&fileop_sema, 1);
   load_avg = fix_int(0);
 
-  if (thread_mlfqs) {
-    int i;
-    for (i = PRI_MIN; i <= PRI_MAX; i++)
-        list_init(&mlfqs_lists[i]);
-  }
-  
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
@@ -179,9 +216,8 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The new thread preempts the caller only if it has a higher
+   priority. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux)
@@ -193,27 +229,42 @@ thread_create (const char *name, int priority,
   tid_t tid;
   struct thread* cur = thread_current();
   struct thread_wait_context *wctx;
+  enum intr_level old_level;
 
   ASSERT (function != NULL);
 
-  /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  /* Allocate thread, preferably from the pool.  init_thread()
+     clears the struct thread; the rest of the page is stack and
+     needs no zeroing. */
+  old_level = intr_disable ();
+  if (!list_empty (&thread_pool))
+    {
+      t = list_entry (list_pop_front (&thread_pool), struct thread, elem);
+      thread_pool_cnt--;
+    }
+  else
+    t = NULL;
+  intr_set_level (old_level);
   if (t == NULL)
+    t = palloc_get_page (0);
+  if (t == NULL)
+    return TID_ERROR;
+  wctx = malloc(sizeof(struct thread_wait_context));
+  if (wctx == NULL) {
+    palloc_free_page (t);
     return TID_ERROR;
+  }
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
 
-  if (cur != NULL) {
-    wctx = malloc(sizeof(struct thread_wait_context));
-    wctx->tid = tid;
-    sema_init(&wctx->finish_sema, 0);
-    wctx->exit_status = 0;
-    wctx->waited = 0;
-    list_push_front(&cur->children, &wctx->children_elem);
-    t->wait_ctx = wctx;
-  }
+  wctx->tid = tid;
+  sema_init(&wctx->finish_sema, 0);
+  wctx->exit_status = 0;
+  wctx->waited = 0;
+  list_push_front(&cur->children, &wctx->children_elem);
+  t->wait_ctx = wctx;
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -232,7 +283,8 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
-  thread_yield();
+  if (t->priority > cur->priority)
+    thread_yield();
 
   return tid;
 }
@@ -270,11 +322,9 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  // list_push_back (&ready_list, &t->elem);
-  if (thread_mlfqs)
-    list_push_back(&mlfqs_lists[t->priority], &t->mlfqs_elem);
-  list_insert_ordered(&ready_list, &t->elem, thread_priority_cmp, NULL);
+  ready_push (t);
   t->status = THREAD_READY;
+  trace (TRACE_WAKEUP, t->tid, running_thread ()->tid, t->priority);
   intr_set_level (old_level);
 }
 
@@ -327,6 +377,7 @@ thread_exit (void)
      when it calls thread_schedule_tail(). */
   intr_disable ();
   list_remove (&thread_current()->allelem);
+  mlfqs_forget (thread_current ());
   thread_current ()->status = THREAD_DYING;
   schedule ();
   NOT_REACHED ();
@@ -343,33 +394,100 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread){
-    // list_push_back (&ready_list, &cur->elem);
-    if (thread_mlfqs)
-      list_push_back(&mlfqs_lists[cur->priority], &cur->mlfqs_elem);
-    list_insert_ordered(&ready_list, &cur->elem,
-              thread_priority_cmp, NULL);
-  }
+  if (cur != idle_thread)
+    ready_push (cur);
   cur->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-// function to compare two sleep_thread_entry (by wakeup_time)
-bool
-wakeup_time_cmp(const struct list_elem *a,
-        const struct list_elem *b,
-        void *aux UNUSED)
+/* Makes room in sleep_heap for at least one more sleeper.
+   Returns with interrupts off and the previous interrupt level
+   in *OLD_LEVEL if successful, otherwise with the interrupt level
+   unchanged. */
+static bool
+sleep_heap_reserve (enum intr_level *old_level)
+{
+  for (;;)
+    {
+      struct sleep_thread_entry **grown, **stale;
+      size_t cap;
+
+      *old_level = intr_disable ();
+      if (sleep_cnt < sleep_cap)
+        return true;
+      cap = sleep_cap;
+      intr_set_level (*old_level);
+
+      grown = malloc ((cap ? cap * 2 : 16) * sizeof *grown);
+      if (grown == NULL)
+        return false;
+
+      /* Another thread may have grown the heap while interrupts
+         were on. */
+      *old_level = intr_disable ();
+      if (sleep_cap == cap)
+        {
+          memcpy (grown, sleep_heap, sleep_cnt * sizeof *grown);
+          stale = sleep_heap;
+          sleep_heap = grown;
+          sleep_cap = cap ? cap * 2 : 16;
+        }
+      else
+        stale = grown;
+      intr_set_level (*old_level);
+      free (stale);
+    }
+}
+
+/* Restores the heap property by moving sleep_heap[I] toward the
+   root. */
+static void
+sleep_heap_up (size_t i)
 {
-  struct sleep_thread_entry *st1 = list_entry(a, struct sleep_thread_entry,
-          elem);
-  struct sleep_thread_entry *st2 = list_entry(b, struct sleep_thread_entry,
-          elem);
+  struct sleep_thread_entry *st = sleep_heap[i];
 
-  return st1->wakeup_ticks < st2->wakeup_ticks;
+  while (i > 0)
+    {
+      size_t parent = (i - 1) / 2;
+      if (sleep_heap[parent]->wakeup_ticks <= st->wakeup_ticks)
+        break;
+      sleep_heap[i] = sleep_heap[parent];
+      i = parent;
+    }
+  sleep_heap[i] = st;
+}
+
+/* Removes and returns the sleeper with the earliest deadline. */
+static struct sleep_thread_entry *
+sleep_heap_pop (void)
+{
+  struct sleep_thread_entry *min = sleep_heap[0];
+  struct sleep_thread_entry *last = sleep_heap[--sleep_cnt];
+  size_t i = 0;
+
+  for (;;)
+    {
+      size_t child = 2 * i + 1;
+      if (child >= sleep_cnt)
+        break;
+      if (child + 1 < sleep_cnt
+          && sleep_heap[child + 1]->wakeup_ticks
+             < sleep_heap[child]->wakeup_ticks)
+        child++;
+      if (last->wakeup_ticks <= sleep_heap[child]->wakeup_ticks)
+        break;
+      sleep_heap[i] = sleep_heap[child];
+      i = child;
+    }
+  if (sleep_cnt > 0)
+    sleep_heap[i] = last;
+  return min;
 }
 
-// Put thread into sleep status
+// Put thread into sleep status until timer ticks reach WAKEUP_TICKS.
+// May return early (e.g. if memory for the sleep heap runs out), so
+// callers should recheck the time.
 void
 thread_sleep (int64_t wakeup_ticks)
 {
@@ -379,37 +497,44 @@ thread_sleep (int64_t wakeup_ticks)
 
   ASSERT(!intr_context());
 
+  if (!sleep_heap_reserve(&old_level)) {
+    thread_yield();
+    return;
+  }
   sema_init(&sema, 0);
   sleep_thread.sema = &sema;
   sleep_thread.wakeup_ticks = wakeup_ticks;
-  old_level = intr_disable();
-  list_insert_ordered(&sleep_list, &sleep_thread.elem,
-          wakeup_time_cmp, NULL);
+  sleep_heap[sleep_cnt++] = &sleep_thread;
+  sleep_heap_up(sleep_cnt - 1);
   intr_set_level(old_level);
   sema_down(&sema);
 }
 
-// wake up thread when time's up
+// Returns the timer tick at which the next sleeping thread is due,
+// or INT64_MAX if no thread is sleeping.
+int64_t
+thread_next_wakeup (void)
+{
+  enum intr_level old_level;
+  int64_t wakeup;
+
+  old_level = intr_disable();
+  wakeup = sleep_cnt > 0 ? sleep_heap[0]->wakeup_ticks : INT64_MAX;
+  intr_set_level(old_level);
+  return wakeup;
+}
+
+// wake up every thread whose wakeup time has been reached.  The
+// earliest deadline is at the top of the heap, so a tick with
+// nothing due costs one comparison.
 void
 thread_wakeup (int64_t current_ticks)
 {
-  struct sleep_thread_entry *st;
-  struct list_elem *e;
   enum intr_level old_level;
 
   old_level = intr_disable();
-  for (e = list_begin(&sleep_list);
-          e != list_end(&sleep_list);
-          e = list_next(e)) {
-    st = list_entry(e, struct sleep_thread_entry, elem);
-    if(st->wakeup_ticks >= current_ticks) {
-      sema_up(st->sema);
-      list_remove(e);
-    }
-    else {
-      break;
-    }
-  }
+  while (sleep_cnt > 0 && sleep_heap[0]->wakeup_ticks <= current_ticks)
+    sema_up(sleep_heap_pop()->sema);
   intr_set_level(old_level);
 }
 
@@ -435,22 +560,96 @@ void
 thread_set_priority (int new_priority)
 {
   struct thread *t = thread_current();
+  enum intr_level old_level;
 
-  // if thread is being donate, set original thread and ignore
-  if (list_size(&t->holdings) != 0) {
-    struct list_elem *e;
-    struct lock *l;
+  // donations still apply on top of the new base priority
+  old_level = intr_disable();
+  t->base_priority = new_priority;
+  thread_update_priority(t);
+  intr_set_level(old_level);
+  thread_yield();
+}
 
-    for(e = list_begin(&t->holdings);
-            e != list_end(&t->holdings);
-            e = list_next(e)){
-        l = list_entry(e, struct lock, elem);
-        l->holder_priority = new_priority;
-    }
+/* Returns the highest priority set in MASK, a bitmap of
+   priorities, which must not be empty. */
+static int
+highest_priority (uint64_t mask)
+{
+  uint32_t high = mask >> 32;
+
+  /* BSR has no 64-bit form on 32-bit x86, so look at one half
+     at a time. */
+  ASSERT (mask != 0);
+  return (high != 0
+          ? 63 - __builtin_clz (high)
+          : 31 - __builtin_clz ((uint32_t) mask));
+}
+
+/* Records that T receives a donation of PRIORITY, from a lock it
+   holds.  T keeps a count of its donations at each priority and
+   a bitmap of the priorities with nonzero counts, so that its
+   highest donation is found in constant time.  Call
+   thread_update_priority() to apply the change.  Interrupts must
+   be off. */
+void
+thread_donate (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->donations[priority]++ == 0)
+    t->donation_mask |= (uint64_t) 1 << priority;
+}
+
+/* Withdraws a donation of PRIORITY to T made by
+   thread_donate(). */
+void
+thread_undonate (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->donations[priority] > 0);
+
+  if (--t->donations[priority] == 0)
+    t->donation_mask &= ~((uint64_t) 1 << priority);
+}
+
+/* Sets T's priority to the higher of its base priority and the
+   highest donation it receives.  Does nothing under the MLFQS,
+   which computes priorities itself.  Interrupts must be off. */
+void
+thread_update_priority (struct thread *t)
+{
+  int priority = t->base_priority;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_mlfqs)
     return;
-  }
-  t->priority = new_priority;
-  thread_yield();
+  if (t->donation_mask != 0 && highest_priority (t->donation_mask) > priority)
+    priority = highest_priority (t->donation_mask);
+  thread_reprioritize (t, priority);
+}
+
+/* Sets T's priority to PRIORITY, moving T to the end of the run
+   queue FIFO for its new priority if it is ready. */
+void
+thread_reprioritize (struct thread *t, int priority)
+{
+  enum intr_level old_level;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  if (t->status == THREAD_READY && t->priority != priority)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
+  intr_set_level (old_level);
 }
 
 /* Returns the current thread's priority. */
@@ -464,7 +663,13 @@ thread_get_priority (void)
 void
 thread_set_nice (int nice)
 {
-    thread_current()->nice = nice;
+    struct thread *t = thread_current();
+
+    t->nice = nice;
+    if (thread_mlfqs) {
+        thread_reprioritize(t, mlfqs_get_priority(t));
+        thread_yield();
+    }
 }
 
 /* Returns the current thread's nice value. */
@@ -510,6 +715,10 @@ idle (void *idle_started_ UNUSED)
       intr_disable ();
       thread_block ();
 
+      /* Stop the periodic tick if nothing needs it for a while.
+         The scheduler restarts it when we are switched out. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -582,20 +791,18 @@ init_thread (struct thread *t, const char *name, int priority)
   lock_init(&t->fds_lock);
   t->stack = (uint8_t *) t + PGSIZE;
   t->magic = THREAD_MAGIC;
-  list_init(&t->holdings);
   t->waiting = NULL;
+  t->waiting_rw = NULL;
   t->waiting_sema = NULL;
   list_init(&t->children);
-  memset(t->cwd, 0, sizeof(char) * PATH_MAX);
+  t->cwd = NULL;
   // current thread is main thread
   if (cur == NULL) {
-    *(t->cwd) = '/';
     t->recent_cpu = fix_int(0);
     t->nice = 0;
   }
   // properties inherit from parent process
   else {
-    memcpy(t->cwd, cur->cwd, strlen(cur->cwd));
     t->recent_cpu = cur->recent_cpu;
     t->nice = cur->nice;
   }
@@ -603,6 +810,7 @@ init_thread (struct thread *t, const char *name, int priority)
     t->priority = mlfqs_get_priority(t);
   else
     t->priority = priority;
+  t->base_priority = priority;
 
   old_level = intr_disable ();
   list_push_back (&all_list, &t->allelem);
@@ -634,6 +842,42 @@ thread_priority_cmp(const struct list_elem *a,
     return t1->priority > t2->priority;
 }
 
+/* Adds ready thread T to the end of its priority's run queue
+   FIFO. */
+static void
+ready_push (struct thread *t)
+{
+  list_push_back (&ready_queues[t->priority], &t->elem);
+  ready_mask |= (uint64_t) 1 << t->priority;
+  ready_cnt++;
+}
+
+/* Removes ready thread T from the run queue. */
+static void
+ready_remove (struct thread *t)
+{
+  list_remove (&t->elem);
+  if (list_empty (&ready_queues[t->priority]))
+    ready_mask &= ~((uint64_t) 1 << t->priority);
+  ready_cnt--;
+}
+
+/* Removes and returns the first thread of highest priority in
+   the run queue, or a null pointer if the run queue is empty. */
+static struct thread *
+ready_pop (void)
+{
+  struct thread *t;
+
+  if (ready_mask == 0)
+    return NULL;
+
+  t = list_entry (list_front (&ready_queues[highest_priority (ready_mask)]),
+                  struct thread, elem);
+  ready_remove (t);
+  return t;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
@@ -642,23 +886,8 @@ thread_priority_cmp(const struct list_elem *a,
 static struct thread *
 next_thread_to_run (void)
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else if (thread_mlfqs) {
-    int p;
-    struct thread *t;
-    for (p = PRI_MAX; p >= PRI_MIN; p--) {
-        if (list_empty(&mlfqs_lists[p]))
-            continue;
-        t = list_entry(list_pop_front(&mlfqs_lists[p]),
-                struct thread, mlfqs_elem);
-        list_remove(&t->elem);
-        return t;
-    }
-  }
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
-  return NULL;
+  struct thread *t = ready_pop ();
+  return t != NULL ? t : idle_thread;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -703,10 +932,43 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread)
     {
       ASSERT (prev != cur);
-      palloc_free_page (prev);
+      if (thread_pool_cnt < THREAD_POOL_MAX)
+        {
+          list_push_front (&thread_pool, &prev->elem);
+          thread_pool_cnt++;
+        }
+      else
+        palloc_free_page (prev);
     }
 }
 
+/* Palloc shrinker: gives up to PAGE_CNT pooled thread pages back
+   to the kernel pool. */
+static size_t
+thread_pool_shrink (enum palloc_flags flags, size_t page_cnt)
+{
+  size_t freed = 0;
+
+  if (flags & PAL_USER)
+    return 0;
+  while (freed < page_cnt)
+    {
+      enum intr_level old_level = intr_disable ();
+      struct thread *t = NULL;
+      if (!list_empty (&thread_pool))
+        {
+          t = list_entry (list_pop_front (&thread_pool), struct thread, elem);
+          thread_pool_cnt--;
+        }
+      intr_set_level (old_level);
+      if (t == NULL)
+        break;
+      palloc_free_page (t);
+      freed++;
+    }
+  return freed;
+}
+
 /* Schedules a new process.  At entry, interrupts must be off and
    the running process's state must have been changed from
    running to some other state.  This function finds another
@@ -725,8 +987,15 @@ schedule (void)
   ASSERT (cur->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
+  if (cur == idle_thread && next != idle_thread)
+    idle_ticks += timer_idle_exit ();
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      trace (TRACE_SWITCH, cur->tid, next->tid,
+             (cur->status == THREAD_READY ? TRACE_YIELD
+              : cur->status == THREAD_BLOCKED ? TRACE_BLOCK : TRACE_EXIT));
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -737,64 +1006,80 @@ mlfqs_get_priority (struct thread *t)
     fixed_point_t t1;
     int next_p;
     t1 = fix_int(PRI_MAX);
-    t1 = fix_sub(t1, fix_div(t->recent_cpu, fix_int(4)));
+    t1 = fix_sub(t1, fix_unscale(t->recent_cpu, 4));
     t1 = fix_sub(t1, fix_int(t->nice * 2));
     next_p = fix_round(t1);
     return next_p > PRI_MAX ? PRI_MAX:
         (next_p < PRI_MIN ? PRI_MIN : next_p);
 }
 
+// Drop exiting thread T from the charged set so that the next
+// recomputation doesn't touch its freed page.
+static void
+mlfqs_forget (struct thread *t)
+{
+    size_t i;
+
+    ASSERT (intr_get_level () == INTR_OFF);
+
+    for (i = 0; i < charged_cnt; i++)
+        if (charged[i] == t) {
+            charged[i] = charged[--charged_cnt];
+            break;
+        }
+}
+
+// Per-tick MLFQS bookkeeping, called from the timer interrupt.
+// Only the running thread's recent_cpu changes from tick to tick,
+// so the 4-tick recomputation only revisits the threads charged
+// since the last one.  The once-per-second decay has to touch
+// every thread; it computes the decay coefficient once and
+// recomputes each priority in the same pass.  Load average uses
+// the incrementally maintained ready count.
 void
 mlfqs_update(int64_t current_ticks)
 {
+    struct thread *rt;
+    size_t i;
+
     if(!thread_mlfqs)
         return;
-    struct thread *rt = running_thread();
-    int running = running_thread() != idle_thread;
-    if (rt != idle_thread)
+    rt = running_thread();
+    if (rt != idle_thread) {
         rt->recent_cpu = fix_add(rt->recent_cpu, fix_int(1));
+        for (i = 0; i < charged_cnt && charged[i] != rt; i++)
+            continue;
+        if (i == charged_cnt && charged_cnt < 4)
+            charged[charged_cnt++] = rt;
+    }
     if (current_ticks % TIMER_FREQ == 0) {
-        // Update load_avg
-        fixed_point_t t1 = fix_mul(fix_frac(59, 60), load_avg);
-        fixed_point_t t2 = fix_mul(fix_frac(1, 60),
-                fix_int(list_size(&ready_list) + running));
-        load_avg = fix_add(t1, t2);
-        // Update recent_cpu of threads
         struct list_elem *e;
-        struct thread *t;
+        fixed_point_t twice_load, coef;
+        int running = rt != idle_thread;
+
+        // Update load_avg
+        load_avg = fix_add(fix_mul(fix_frac(59, 60), load_avg),
+                fix_unscale(fix_int(ready_cnt + running), 60));
+        // Decay recent_cpu of every thread, then reprioritize it
+        twice_load = fix_scale(load_avg, 2);
+        coef = fix_div(twice_load, fix_add(twice_load, fix_int(1)));
         for (e = list_begin(&all_list);
                 e != list_end(&all_list);
                 e = list_next(e)) {
-            t = list_entry(e, struct thread, allelem);
-            t1 = fix_scale(load_avg, 2);
-            t2 = fix_add(t1, fix_int(1));
-            t1 = fix_div(t1, t2);
-            t1 = fix_mul(t1, t->recent_cpu);
-            t1 = fix_add(t1, fix_int(t->nice));
-            t1 = fix_compare(t1, fix_int(0)) > -1 ?
-                t1: fix_int(0);
-            t->recent_cpu = t1;
+            struct thread *t = list_entry(e, struct thread, allelem);
+            fixed_point_t r = fix_add(fix_mul(coef, t->recent_cpu),
+                    fix_int(t->nice));
+            t->recent_cpu = fix_compare(r, fix_int(0)) > -1 ?
+                r: fix_int(0);
+            thread_reprioritize(t, mlfqs_get_priority(t));
         }
+        charged_cnt = 0;
     }
-    if (current_ticks % 4 == 0) {
-        struct list_elem *e;
-        struct thread *t;
-        int prev_p;
-        for (e = list_begin(&all_list);
-                e != list_end(&all_list);
-                e = list_next(e)) {
-            t = list_entry(e, struct thread, allelem);
-            prev_p = t->priority;
-            t->priority = mlfqs_get_priority(t);
-            if (prev_p != t->priority && t->status == THREAD_READY) {
-               list_remove(&t->mlfqs_elem); 
-               list_push_back(&mlfqs_lists[t->priority],
-                       &t->mlfqs_elem);
-            }
-        }
+    else if (current_ticks % 4 == 0) {
+        for (i = 0; i < charged_cnt; i++)
+            thread_reprioritize(charged[i], mlfqs_get_priority(charged[i]));
+        charged_cnt = 0;
     }
-
-    
 }
 
 /* Returns a tid to use for a new thread. */
@@ -7,7 +7,6 @@
 #include "threads/synch.h"
 #include "threads/fixed-point.h"
 #include "filesys/off_t.h"
-#include "filesys/directory.h"
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -105,19 +104,30 @@ struct thread
 
     /* Owned by thread.c. */
     unsigned magic;                     /* Detects stack overflow. */
-    struct list holdings;
-    struct lock *waiting;
+    int base_priority;                  /* Priority before donation. */
+    uint64_t donation_mask;             /* Priorities donated to us. */
+    unsigned short donations[PRI_MAX + 1]; /* Donations per priority. */
+    struct lock *waiting;               /* Lock we are waiting for. */
+    struct rwlock *waiting_rw;          /* Rwlock we are waiting for, */
+    bool waiting_write;                 /*   and whether to write. */
+    struct rwlock_hold rw_holds[RWLOCK_HOLD_MAX]; /* Rwlocks held. */
+    struct thread *ts_child;            /* Turnstile heap links and */
+    struct thread *ts_sibling;          /*   key while waiting for */
+    struct thread *ts_prev;             /*   a lock; see synch.c. */
+    int ts_priority;
+    unsigned ts_seq;
     struct semaphore *waiting_sema;
     int nice;
     fixed_point_t recent_cpu;
-    struct list_elem mlfqs_elem;
     struct thread* parent;
     struct list fds;
     struct lock fds_lock;
     struct list children;
     struct thread_wait_context *wait_ctx;
-    // Process current working directory
-    char cwd[PATH_MAX];
+    // Process current working directory, NULL means the root
+    struct dir *cwd;
+    // Nesting depth of file system journal operations
+    int journal_depth;
   };
 
 struct thread_wait_context {
@@ -140,7 +150,6 @@ struct file_fd {
 
 // Struct for manage sleeping threads
 struct sleep_thread_entry {
-    struct list_elem elem;
     struct semaphore *sema;
     int64_t wakeup_ticks;
 };
@@ -168,10 +177,10 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
-list_less_func wakeup_time_cmp;
 list_less_func thread_priority_cmp;
 void thread_sleep (int64_t wakeup_ticks);
 void thread_wakeup (int64_t current_ticks);
+int64_t thread_next_wakeup (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -179,6 +188,10 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate (struct thread *, int priority);
+void thread_undonate (struct thread *, int priority);
+void thread_update_priority (struct thread *);
+void thread_reprioritize (struct thread *, int priority);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
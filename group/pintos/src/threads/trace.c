@@ -0,0 +1,120 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+/* A recorded event. */
+struct trace_event
+  {
+    uint64_t tsc;               /* Time-stamp counter. */
+    uint32_t arg;               /* Type-specific argument. */
+    int32_t a, b;               /* Type-specific thread IDs. */
+    uint8_t type;               /* An enum trace_type. */
+  };
+
+/* Default buffer size, in kB, for "-trace" with no size. */
+#define TRACE_DEFAULT_KB 64
+
+bool trace_active;
+
+static size_t buffer_kb;                /* Requested size, 0 if off. */
+static struct trace_event *events;      /* Ring buffer. */
+static size_t event_cnt;                /* Capacity of ring buffer. */
+static uint64_t recorded;               /* Events ever recorded. */
+
+/* Enables tracing into a buffer of SIZE kB, or the default size
+   if SIZE is null.  Called while parsing the kernel command
+   line, before the buffer can be allocated. */
+void
+trace_configure (const char *size)
+{
+  buffer_kb = size != NULL ? (size_t) atoi (size) : TRACE_DEFAULT_KB;
+  if (buffer_kb == 0)
+    PANIC ("-trace: bad buffer size \"%s\"", size);
+}
+
+/* Allocates the trace buffer and starts recording, if tracing
+   was requested.  Must be called after palloc_init(). */
+void
+trace_init (void)
+{
+  size_t page_cnt;
+
+  if (buffer_kb == 0)
+    return;
+  page_cnt = DIV_ROUND_UP (buffer_kb * 1024, PGSIZE);
+  events = palloc_get_multiple (0, page_cnt);
+  if (events == NULL)
+    {
+      printf ("trace: could not allocate %zu kB, tracing disabled\n",
+              buffer_kb);
+      return;
+    }
+  event_cnt = page_cnt * PGSIZE / sizeof *events;
+  printf ("trace: recording up to %zu scheduler events\n", event_cnt);
+  trace_active = true;
+}
+
+/* Records an event of the given TYPE with arguments A, B and
+   ARG.  Use the trace() wrapper instead of calling this
+   directly. */
+void
+trace_record (enum trace_type type, int a, int b, uint32_t arg)
+{
+  enum intr_level old_level;
+  struct trace_event *e;
+
+  old_level = intr_disable ();
+  e = &events[recorded++ % event_cnt];
+  e->tsc = timer_cycles ();
+  e->type = type;
+  e->a = a;
+  e->b = b;
+  e->arg = arg;
+  intr_set_level (old_level);
+}
+
+/* Prints the recorded events, oldest first, one per line:
+
+     T <tsc> <event> <a> <b> <arg>
+
+   where <event> is one of switch, wakeup, donate, block,
+   handoff or tick, and <a>, <b> and <arg> are as described in
+   trace.h, with the switch reason spelled out as yield, block
+   or exit and lock addresses in hex.  Events are not recorded
+   while the dump is in progress. */
+void
+trace_dump (void)
+{
+  static const char *names[] =
+    { "switch", "wakeup", "donate", "block", "handoff", "tick" };
+  static const char *reasons[] = { "yield", "block", "exit" };
+  uint64_t first, i;
+
+  if (events == NULL)
+    return;
+
+  trace_active = false;
+  first = recorded > event_cnt ? recorded - event_cnt : 0;
+  printf ("Trace: %"PRIu64" events, %"PRIu64" overwritten\n",
+          recorded, first);
+  for (i = first; i < recorded; i++)
+    {
+      const struct trace_event *e = &events[i % event_cnt];
+
+      printf ("T %"PRIu64" %s %d %d ", e->tsc, names[e->type], e->a, e->b);
+      if (e->type == TRACE_SWITCH)
+        printf ("%s\n", reasons[e->arg]);
+      else if (e->type == TRACE_LOCK_BLOCK || e->type == TRACE_LOCK_HANDOFF)
+        printf ("%#"PRIx32"\n", e->arg);
+      else
+        printf ("%"PRIu32"\n", e->arg);
+    }
+  trace_active = true;
+}
@@ -0,0 +1,61 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Scheduler event tracing.
+
+   When enabled with the "-trace" kernel command-line option,
+   the scheduler and synchronization primitives record events in
+   a fixed-size ring buffer, each stamped with the CPU's
+   time-stamp counter.  Recording takes a few dozen instructions
+   with interrupts off and never prints, so it is safe anywhere,
+   including inside schedule() and interrupt handlers.  Once the
+   buffer is full, the oldest events are overwritten.
+   trace_dump() prints the buffer; it is called at shutdown. */
+
+/* Kinds of events.  The meaning of each event's A, B and ARG is
+   given in parentheses. */
+enum trace_type
+  {
+    TRACE_SWITCH,       /* Context switch (prev tid, next tid,
+                           enum trace_reason). */
+    TRACE_WAKEUP,       /* Thread made ready (woken tid, waker tid,
+                           woken priority). */
+    TRACE_DONATE,       /* Priority donation (receiver tid, donor
+                           tid, new priority). */
+    TRACE_LOCK_BLOCK,   /* Blocked on lock (waiter tid, holder tid,
+                           lock address). */
+    TRACE_LOCK_HANDOFF, /* Lock passed on release (new holder tid,
+                           releaser tid, lock address). */
+    TRACE_TICK          /* Timer tick (running tid, 0, tick). */
+  };
+
+/* Why a context switch happened, from the previous thread's
+   point of view. */
+enum trace_reason
+  {
+    TRACE_YIELD,        /* Still ready: yielded or preempted. */
+    TRACE_BLOCK,        /* Blocked. */
+    TRACE_EXIT          /* Exited. */
+  };
+
+/* True while events are being recorded. */
+extern bool trace_active;
+
+void trace_configure (const char *size);
+void trace_init (void);
+void trace_record (enum trace_type, int a, int b, uint32_t arg);
+void trace_dump (void);
+
+/* Records an event if tracing is active.  Costs one test of a
+   global when it is not. */
+static inline void
+trace (enum trace_type type, int a, int b, uint32_t arg)
+{
+  if (trace_active)
+    trace_record (type, a, b, arg);
+}
+
+#endif /* threads/trace.h */
@@ -0,0 +1,302 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stddef.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* A work queue. */
+struct workqueue
+  {
+    const char *name;           /* Name, also used for the workers. */
+    struct list pending;        /* Pending work, by priority. */
+    struct semaphore work_sema; /* Up once for each queued work. */
+    int busy_cnt;               /* Pending plus running work. */
+    struct list flushers;       /* Threads in workqueue_flush(). */
+  };
+
+/* A thread waiting in workqueue_flush(). */
+struct flusher
+  {
+    struct list_elem elem;      /* Element in queue's flushers. */
+    struct semaphore sema;      /* Up when the queue goes idle. */
+  };
+
+/* Delayed work on every queue, in order of due tick.  The timer
+   interrupt moves work from here to its queue when it falls
+   due.
+
+   Work queues are shared between threads and the timer
+   interrupt, so interrupts must be off to access any of their
+   lists. */
+static struct list delayed_list = LIST_INITIALIZER (delayed_list);
+
+static thread_func worker;
+static void enqueue (struct workqueue *, struct work *);
+static void wake_flushers (struct workqueue *);
+
+/* Initializes W to run FUNC, at dispatch priority PRIORITY,
+   when queued. */
+void
+work_init (struct work *w, work_func *func, int priority)
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->func = func;
+  w->priority = priority;
+  w->state = WORK_IDLE;
+  w->wq = NULL;
+}
+
+/* Creates a work queue named NAME, served by WORKER_CNT threads
+   that run at PRIORITY.  Returns the new queue, or a null
+   pointer if memory or threads cannot be allocated.  Work queues
+   are never destroyed. */
+struct workqueue *
+workqueue_create (const char *name, int worker_cnt, int priority)
+{
+  struct workqueue *wq;
+  int i;
+
+  ASSERT (worker_cnt > 0);
+
+  wq = malloc (sizeof *wq);
+  if (wq == NULL)
+    return NULL;
+  wq->name = name;
+  list_init (&wq->pending);
+  sema_init (&wq->work_sema, 0);
+  wq->busy_cnt = 0;
+  list_init (&wq->flushers);
+
+  for (i = 0; i < worker_cnt; i++)
+    if (thread_create (name, priority, worker, wq) == TID_ERROR)
+      {
+        /* Workers never exit, so the queue can only be freed if
+           none has started. */
+        if (i == 0)
+          {
+            free (wq);
+            return NULL;
+          }
+        break;
+      }
+  return wq;
+}
+
+/* Queues W on WQ to run as soon as a worker is free.  Returns
+   true if successful, false if W was already queued.  May be
+   called from an interrupt handler. */
+bool
+workqueue_queue (struct workqueue *wq, struct work *w)
+{
+  enum intr_level old_level;
+  bool queued = false;
+
+  old_level = intr_disable ();
+  if (w->state == WORK_IDLE)
+    {
+      enqueue (wq, w);
+      queued = true;
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Queues W on WQ to run once TICKS timer ticks have passed.
+   Returns true if successful, false if W was already queued.
+   May be called from an interrupt handler. */
+bool
+workqueue_queue_delayed (struct workqueue *wq, struct work *w,
+                         int64_t ticks)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+  bool queued = false;
+
+  if (ticks <= 0)
+    return workqueue_queue (wq, w);
+
+  old_level = intr_disable ();
+  if (w->state == WORK_IDLE)
+    {
+      w->state = WORK_DELAYED;
+      w->wq = wq;
+      w->due = timer_ticks () + ticks;
+      for (e = list_begin (&delayed_list); e != list_end (&delayed_list);
+           e = list_next (e))
+        if (list_entry (e, struct work, elem)->due > w->due)
+          break;
+      list_insert (e, &w->elem);
+      queued = true;
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Cancels W if it has not yet started to run.  Returns true if
+   W was pending or delayed and has been cancelled, false if it
+   was not queued.  W may still be running when this function
+   returns; use workqueue_flush() to wait for it. */
+bool
+workqueue_cancel (struct work *w)
+{
+  enum intr_level old_level;
+  bool cancelled = true;
+
+  old_level = intr_disable ();
+  if (w->state == WORK_PENDING)
+    {
+      list_remove (&w->elem);
+      if (--w->wq->busy_cnt == 0)
+        wake_flushers (w->wq);
+    }
+  else if (w->state == WORK_DELAYED)
+    list_remove (&w->elem);
+  else
+    cancelled = false;
+  w->state = WORK_IDLE;
+  w->wq = NULL;
+  intr_set_level (old_level);
+  return cancelled;
+}
+
+/* Waits until WQ has no work pending or running.  Delayed work
+   that has not yet fallen due is not waited for. */
+void
+workqueue_flush (struct workqueue *wq)
+{
+  enum intr_level old_level;
+  struct flusher f;
+
+  ASSERT (!intr_context ());
+
+  old_level = intr_disable ();
+  if (wq->busy_cnt > 0)
+    {
+      sema_init (&f.sema, 0);
+      list_push_back (&wq->flushers, &f.elem);
+      intr_set_level (old_level);
+      sema_down (&f.sema);
+    }
+  else
+    intr_set_level (old_level);
+}
+
+/* Moves delayed work that is due at tick NOW to its queue.
+   Called by the timer interrupt handler. */
+void
+workqueue_tick (int64_t now)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&delayed_list))
+    {
+      struct work *w = list_entry (list_front (&delayed_list),
+                                   struct work, elem);
+      if (w->due > now)
+        break;
+      list_pop_front (&delayed_list);
+      enqueue (w->wq, w);
+    }
+}
+
+/* Returns the timer tick at which the next delayed work falls
+   due, or INT64_MAX if there is none. */
+int64_t
+workqueue_next_due (void)
+{
+  enum intr_level old_level;
+  int64_t due = INT64_MAX;
+
+  old_level = intr_disable ();
+  if (!list_empty (&delayed_list))
+    due = list_entry (list_front (&delayed_list), struct work, elem)->due;
+  intr_set_level (old_level);
+  return due;
+}
+
+/* Returns true if work A should be dispatched before work B,
+   that is, if it has a higher priority. */
+static bool
+work_before (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct work *a = list_entry (a_, struct work, elem);
+  const struct work *b = list_entry (b_, struct work, elem);
+
+  return a->priority > b->priority;
+}
+
+/* Adds W to the pending work of WQ, behind any work of the same
+   or higher priority, and wakes a worker.  Interrupts must be
+   off. */
+static void
+enqueue (struct workqueue *wq, struct work *w)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  w->state = WORK_PENDING;
+  w->wq = wq;
+  list_insert_ordered (&wq->pending, &w->elem, work_before, NULL);
+  wq->busy_cnt++;
+  sema_up (&wq->work_sema);
+}
+
+/* Wakes every thread waiting for WQ to go idle.  Interrupts must
+   be off. */
+static void
+wake_flushers (struct workqueue *wq)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&wq->flushers))
+    {
+      struct flusher *f = list_entry (list_pop_front (&wq->flushers),
+                                      struct flusher, elem);
+      sema_up (&f->sema);
+    }
+}
+
+/* Worker thread for work queue WQ_.  Runs pending work, highest
+   priority first, forever. */
+static void
+worker (void *wq_)
+{
+  struct workqueue *wq = wq_;
+
+  for (;;)
+    {
+      enum intr_level old_level;
+      struct work *w;
+      work_func *func;
+
+      sema_down (&wq->work_sema);
+
+      /* The work that upped the semaphore may have been
+         cancelled since. */
+      old_level = intr_disable ();
+      if (list_empty (&wq->pending))
+        {
+          intr_set_level (old_level);
+          continue;
+        }
+      w = list_entry (list_pop_front (&wq->pending), struct work, elem);
+      w->state = WORK_IDLE;
+      w->wq = NULL;
+      func = w->func;
+      intr_set_level (old_level);
+
+      /* W belongs to FUNC from here on: it may be freed or
+         queued again. */
+      func (w);
+
+      old_level = intr_disable ();
+      if (--wq->busy_cnt == 0)
+        wake_flushers (wq);
+      intr_set_level (old_level);
+    }
+}
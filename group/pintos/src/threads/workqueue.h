@@ -0,0 +1,68 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Work queues.
+
+   A work queue runs deferred work on a fixed set of worker
+   threads, so that subsystems need not create a thread for each
+   piece of background work.  A piece of work is a `struct work'
+   embedded in the caller's own structure, in the same way as a
+   `struct list_elem'; the function it runs uses work_entry() to
+   get back to the enclosing structure.
+
+   Pending work is dispatched in order of its priority, and FIFO
+   among work of equal priority.  Work may also be queued after a
+   delay, measured in timer ticks.
+
+   Work is queued at most once at a time: queueing work that is
+   already pending, or waiting out its delay, has no effect.  The
+   work is no longer pending once its function starts, so the
+   function may free the work or queue it again. */
+
+struct work;
+typedef void work_func (struct work *);
+
+/* States of a piece of work. */
+enum work_state
+  {
+    WORK_IDLE,                  /* Not queued. */
+    WORK_PENDING,               /* Waiting for a worker. */
+    WORK_DELAYED                /* Waiting for its delay to expire. */
+  };
+
+/* A piece of deferred work. */
+struct work
+  {
+    struct list_elem elem;      /* Pending or delayed list element. */
+    work_func *func;            /* Function to run. */
+    int priority;               /* Dispatch priority. */
+    enum work_state state;      /* Current state. */
+    struct workqueue *wq;       /* Queue, if not WORK_IDLE. */
+    int64_t due;                /* Tick to queue at, if WORK_DELAYED. */
+  };
+
+/* Converts pointer to work WORK into a pointer to the structure
+   that WORK is embedded inside.  Supply the name of the outer
+   structure STRUCT and the member name MEMBER of the work. */
+#define work_entry(WORK, STRUCT, MEMBER)                        \
+        ((STRUCT *) ((uint8_t *) (WORK) - offsetof (STRUCT, MEMBER)))
+
+void work_init (struct work *, work_func *, int priority);
+
+struct workqueue *workqueue_create (const char *name, int worker_cnt,
+                                    int priority);
+bool workqueue_queue (struct workqueue *, struct work *);
+bool workqueue_queue_delayed (struct workqueue *, struct work *,
+                              int64_t ticks);
+bool workqueue_cancel (struct work *);
+void workqueue_flush (struct workqueue *);
+
+void workqueue_tick (int64_t now);
+int64_t workqueue_next_due (void);
+
+#endif /* threads/workqueue.h */
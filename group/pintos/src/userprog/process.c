@@ -5,13 +5,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "filesys/directory.h"
 #include "filesys/path.h"
 #include "filesys/file.h"
-#include "filesys/path.h"
 #include "filesys/filesys.h"
 #include "threads/flags.h"
 #include "threads/init.h"
@@ -28,6 +28,8 @@ struct exec_file {
 };
 
 static struct list exec_files;
+// exec_files is read on every write() but changes only on exec and exit
+static struct rwlock exec_files_lock;
 static thread_func start_process NO_RETURN;
 static void get_fname(const char *cmdline, char *fname);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
@@ -42,6 +44,7 @@ void
 process_init()
 {
     list_init(&exec_files);
+    rwlock_init(&exec_files_lock, RWLOCK_PREFER_WRITERS);
 }
 
 void get_ppath(const char *cmd, char *ppath)
@@ -84,6 +87,7 @@ process_execute (const char *cmd)
   
   /* Create a new thread to execute FILE_NAME. */
   si.cmd = fn_copy;
+  si.cwd = thread_current()->cwd;
   sema_init(&si.sema, 0);
   tid = thread_create (fname, PRI_DEFAULT, start_process, &si);
   if (tid == TID_ERROR)
@@ -107,6 +111,11 @@ start_process (void *si_)
   struct intr_frame if_;
   bool success;
 
+  /* Inherit the parent's working directory, which stays open
+     while the parent waits on SI->sema. */
+  if (si->cwd != NULL)
+    thread_current ()->cwd = dir_reopen (si->cwd);
+
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
@@ -173,12 +182,14 @@ update_open_cnt(char *fname)
     struct list_elem *e = NULL;
     struct exec_file *ef = NULL;
 
+    rwlock_acquire_write(&exec_files_lock);
     for (e = list_begin(&exec_files);
             e != list_end(&exec_files);
             e = list_next(e)) {
         ef = list_entry(e, struct exec_file, elem);
         if (strcmp(fname, ef->fname) == 0) {
             ef->open_cnt++;
+            rwlock_release(&exec_files_lock);
             return;
         }
     }
@@ -187,6 +198,7 @@ update_open_cnt(char *fname)
     ef->fname = malloc(sizeof(char) * PATH_MAX);
     strlcpy(ef->fname, fname, PATH_MAX);
     list_push_front(&exec_files, &ef->elem);
+    rwlock_release(&exec_files_lock);
 }
 void
 decrease_open_cnt(char *fname)
@@ -194,6 +206,7 @@ decrease_open_cnt(char *fname)
     struct list_elem *e = NULL;
     struct exec_file *ef = NULL;
 
+    rwlock_acquire_write(&exec_files_lock);
     for (e = list_begin(&exec_files);
             e != list_end(&exec_files);
             e = list_next(e)) {
@@ -204,9 +217,10 @@ decrease_open_cnt(char *fname)
                 list_remove(&ef->elem);
                 free(ef);
             }
-            return;
+            break;
         }
     }
+    rwlock_release(&exec_files_lock);
 }
 
 /* Free the current process's resources. */
@@ -230,6 +244,8 @@ process_exit (void)
       free(ffd->fname);
       //free(ffd);
   }
+  dir_close(cur->cwd);
+  cur->cwd = NULL;
   // free children
   for (e = list_begin(&cur->children);
           e != list_end(&cur->children);
@@ -751,19 +767,17 @@ process_open_file(char *path) {
     struct file *file;
     struct file_fd *ffd;
     struct thread *t = thread_current();
-    char fname[NAME_MAX];
-    char *buff = malloc(sizeof(char) * PATH_MAX);
-    int to_return = -1;
-
-    memset(buff, 0, sizeof(char) * PATH_MAX);
-    memcpy(buff, path, strlen(path));
-    to_abs(buff);
-    if (!simplify_path(buff))
-        goto done;
-    path_basename(buff, fname);
-    file = filesys_open(path);
-    if (file == NULL || list_size(&t->fds) > 10)
-        goto done;
+    char fname[NAME_MAX + 1];
+
+    // name the descriptor after the file actually opened, not after
+    // the tail of PATH, which may be "." or ".."
+    file = filesys_open_name(path, fname);
+    if (file == NULL)
+        return -1;
+    if (list_size(&t->fds) > 10) {
+        file_close(file);
+        return -1;
+    }
     ffd = malloc(sizeof(struct file_fd));
     if (file->inode->data.isdir)
         ffd->dir = dir_open(file->inode);
@@ -776,11 +790,7 @@ process_open_file(char *path) {
     strlcpy(ffd->fname, fname, NAME_MAX);
     list_insert_ordered(&t->fds, &ffd->elem,
             fd_cmp_func, NULL);
-    to_return = ffd->fd;
-
-done:
-    free(buff);
-    return to_return;
+    return ffd->fd;
 }
 
 int
@@ -829,6 +839,28 @@ process_close_file(int fd)
     list_remove(&ffd->elem);
     free(ffd);
 }
+// Carries out fcntl command CMD with argument ARG on FD.
+// Returns the file's flags for F_GETFL, 0 for F_SETFL, and -1
+// if FD is not an open file or CMD is unknown.
+int
+process_fcntl(int fd, int cmd, int arg)
+{
+    struct file_fd *ffd = NULL;
+
+    get_filefd_from_fd(fd, &ffd);
+    if (ffd == NULL || ffd->dir != NULL)
+        return -1;
+    switch (cmd) {
+        case F_GETFL:
+            return file_is_direct(ffd->f) ? O_DIRECT : 0;
+        case F_SETFL:
+            file_set_direct(ffd->f, (arg & O_DIRECT) != 0);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
 unsigned
 process_tell_file(int fd)
 {
@@ -846,15 +878,20 @@ ffd_can_write(struct file_fd *ffd)
     struct list_elem *e = NULL;
     struct exec_file *ef = NULL;
 
+    int can_write = 1;
+
+    rwlock_acquire_read(&exec_files_lock);
     for (e = list_begin(&exec_files);
             e != list_end(&exec_files);
             e = list_next(e)) {
         ef = list_entry(e, struct exec_file, elem);
         if (strcmp(ffd->fname, ef->fname) == 0) {
-            return 0;
+            can_write = 0;
+            break;
         }
     }
-    return 1; 
+    rwlock_release(&exec_files_lock);
+    return can_write;
 }
 
 int
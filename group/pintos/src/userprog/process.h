@@ -5,6 +5,7 @@
 
 struct start_info {
     char *cmd;
+    struct dir *cwd;
     bool success;
     struct semaphore sema;
 };
@@ -16,5 +17,6 @@ void process_init (void);
 void process_activate (void);
 void pexit (int status);
 void get_filefd_from_fd(int fd, struct file_fd **ffdp);
+int process_fcntl(int fd, int cmd, int arg);
 
 #endif /* userprog/process.h */
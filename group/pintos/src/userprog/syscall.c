@@ -1,4 +1,5 @@
 #include "userprog/syscall.h"
+#include <stdint.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 #include <list.h>
@@ -8,9 +9,14 @@
 #include "filesys/filesys.h"
 #include "filesys/directory.h"
 #include "threads/vaddr.h"
+#include "devices/block.h"
+#include "userprog/process.h"
 
 static void syscall_handler (struct intr_frame *);
+static bool sys_blockstat(const char *name, struct blockstat *stats);
 bool isvalid_address(void *p);
+static bool isvalid_array(const void *p, size_t cnt, size_t size);
+static bool isvalid_string(const char *s);
 void pexit(int status);
 
 void
@@ -23,6 +29,31 @@ bool isvalid_address(void *p) {
     return (p + 4) < PHYS_BASE;
 }
 
+// Returns true if CNT objects of SIZE bytes each, starting at P,
+// all lie in user memory.  CNT is bounded before it is multiplied,
+// so a huge count cannot wrap around to a valid-looking address.
+static bool isvalid_array(const void *p, size_t cnt, size_t size) {
+    uintptr_t start = (uintptr_t) p;
+
+    if (p == NULL || start >= (uintptr_t) PHYS_BASE)
+        return false;
+    if (cnt > ((uintptr_t) PHYS_BASE - start) / size)
+        return false;
+    // both ends of the array are now known to be below PHYS_BASE
+    return cnt == 0 || start + cnt * size - 1 < (uintptr_t) PHYS_BASE;
+}
+
+// Returns true if the whole of string S, up to and including its
+// null terminator, lies in user memory.
+static bool isvalid_string(const char *s) {
+    if (s == NULL)
+        return false;
+    for (; (const void *) s < PHYS_BASE; s++)
+        if (*s == '\0')
+            return true;
+    return false;
+}
+
 void pexit(int status) {
     struct thread *cur = thread_current();
 
@@ -149,8 +180,42 @@ syscall_handler (struct intr_frame *f UNUSED)
     case SYS_READDIR:
         f->eax = readdir(args[1], args[2]);
         break;
+    case SYS_GETDENTS:
+        if (!isvalid_array((void *) args[4], 1, sizeof (unsigned))
+                || !isvalid_array((void *) args[2], args[3],
+                    sizeof (struct dirent))) {
+            f->eax = -1;
+            pexit(-1);
+        }
+        f->eax = getdents(args[1], (struct dirent *) args[2], args[3],
+                (unsigned *) args[4]);
+        break;
+    case SYS_FCNTL:
+        f->eax = process_fcntl(args[1], args[2], args[3]);
+        break;
+    case SYS_BLOCKSTAT:
+        if (!isvalid_string((const char *) args[1])
+                || !isvalid_array((void *) args[2], 1,
+                    sizeof (struct blockstat))) {
+            f->eax = -1;
+            pexit(-1);
+        }
+        f->eax = sys_blockstat((const char *) args[1],
+                (struct blockstat *) args[2]);
+        break;
     case SYS_TEST_SIMPATH:
         f->eax = simplify_path(args[1]);
         break;
   }
 }
+
+// Copies the statistics of the block device called NAME into
+// STATS.  Returns false if there is no such device.
+static bool sys_blockstat(const char *name, struct blockstat *stats) {
+    struct block *block = block_get_by_name(name);
+
+    if (block == NULL)
+        return false;
+    block_get_stats(block, stats);
+    return true;
+}